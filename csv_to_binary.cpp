@@ -0,0 +1,27 @@
+#include <iostream>
+#include "binary_dataset.h"
+#include "dataset_loader.h"
+#include <chrono>
+
+using namespace std;
+using namespace chrono;
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        cerr << "Usage: " << argv[0] << " <input.csv> <output.kmb>" << endl;
+        return -1;
+    }
+    const string csvPath = argv[1];
+    const string binaryPath = argv[2];
+
+    DataPoints dataPoints;
+    if (!readDatasetFromFile(dataPoints, csvPath)) return -1;
+
+    auto startTime = high_resolution_clock::now();
+    if (!writeBinaryDataset(dataPoints, binaryPath)) return -1;
+    auto endTime = high_resolution_clock::now();
+    auto time = duration_cast<microseconds>(endTime - startTime).count() / 1000.f;
+    cout << "Wrote " << dataPoints.size() << " points to " << binaryPath << " in " << time << " ms" << endl;
+
+    return 0;
+}
@@ -0,0 +1,271 @@
+#include <iostream>
+#include "dataset_loader.h"
+#include "assignment_kernel.h"
+#include "centroid_config.h"
+#include "gemm_engine.h"
+#include "kmeans_model.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+using namespace std;
+
+static const vector<string> DATASET_PATHS = {
+        "../datasets/generated_blob_dataset_4k.csv",
+        "../datasets/generated_blob_dataset_40k.csv",
+        "../datasets/generated_blob_dataset_400k.csv"};
+static const string CONFIG_FILE_PATH = "../config_files/config_sets.ini";
+static const vector<string> DESIRED_CONFIGS = {"2_cluster", "4_cluster", "8_cluster", "16_cluster",
+                                               "256_cluster_kmeans||"};
+// The parallel version runs once per thread count and backend; AoS and SoA always use one thread.
+static const vector<int> THREAD_COUNTS = {1, 2, 4, 8, 16};
+static const vector<ExecutionBackend> PARALLEL_BACKENDS = {openMPBackend(), workerPoolBackend()};
+// SoA and parallel runs are repeated with every engine; AoS always scans every centroid.
+static const vector<AssignmentEngine> ENGINES = {AssignmentEngine::BruteForce, AssignmentEngine::Hamerly,
+                                                 AssignmentEngine::Yinyang, AssignmentEngine::Filtering,
+                                                 AssignmentEngine::Gemm};
+static const int ITERATION_NUMBER = 10;
+// Untimed runs before the measured repetitions, to warm caches and page in the dataset.
+static const int WARMUP_RUNS = 1;
+static const int REPETITIONS = 5;
+static const string JSON_REPORT_PATH = "k_means_bench.json";
+static const string CSV_REPORT_PATH = "k_means_bench.csv";
+
+struct BenchResult {
+    string dataset;
+    string config;
+    string version;
+    string kernel;
+    string engine;
+    int threads;
+    size_t points;
+    int dimension;
+    int clusters;
+    int iterations;
+    float medianDuration;
+    float p95Duration;
+    float minDuration;
+    double pointsPerSecond;
+    double engineMegabytes;
+    // Against the brute-force sequential SoA run of the same dataset and config.
+    double speedup;
+};
+
+string engineName(AssignmentEngine engine) {
+    switch (engine) {
+        case AssignmentEngine::Hamerly: return "Hamerly";
+        case AssignmentEngine::Yinyang: return "Yinyang";
+        case AssignmentEngine::Filtering: return "filtering";
+        case AssignmentEngine::Gemm: return "GEMM";
+        default: return "brute force";
+    }
+}
+
+// Nearest-rank percentile of sorted durations.
+float percentile(const vector<float>& sortedDurations, double fraction) {
+    size_t rank = static_cast<size_t>(ceil(fraction * sortedDurations.size()));
+    return sortedDurations[max<size_t>(rank, 1) - 1];
+}
+
+// The GEMM engine must give the kernel's labels, also when a cluster is empty
+// (its centroid is NaN): none, the first one, or one in the middle.
+bool checkGemmLabels(const DataPoints& dataPoints, const DataPoints& centroids) {
+    const int dimension = dataPoints.dimension();
+    const int clusterNum = static_cast<int>(centroids.size());
+    const AssignmentKernel kernel = selectAssignmentKernel(dimension, clusterNum);
+    const vector<const float*> pointColumns = dataPoints.columnData();
+    for (int emptyCluster : {-1, 0, clusterNum / 2}) {
+        DataPoints tested = centroids;
+        if (emptyCluster >= 0) {
+            for (int d = 0; d < dimension; d++) tested[d][emptyCluster] = NAN;
+        }
+        const vector<const float*> centroidColumns = tested.columnData();
+        vector<int> kernelLabels(dataPoints.size());
+        for (size_t block = 0; block < dataPoints.size(); block += ASSIGNMENT_BLOCK_SIZE) {
+            const size_t blockSize = min(ASSIGNMENT_BLOCK_SIZE, dataPoints.size() - block);
+            kernel.assign(pointColumns.data(), block, blockSize, centroidColumns.data(), dimension, clusterNum,
+                          kernelLabels.data() + block);
+        }
+        GemmEngine gemm;
+        gemm.update(tested);
+        vector<int> gemmLabels(dataPoints.size());
+        gemm.assign(dataPoints, 0, dataPoints.size(), gemmLabels.data());
+        if (gemmLabels != kernelLabels) {
+            cerr << "Error: the GEMM engine and the kernel disagree";
+            if (emptyCluster >= 0) cerr << " with cluster " << emptyCluster + 1 << " empty";
+            cerr << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool benchmark(const ExecutionBackend& backend, int threadNum, AssignmentEngine engine, const DataPoints& dataPoints,
+               const DataPoints& centroids, BenchResult& result) {
+    KMeansModel model(backend);
+    model.options().iterationNum = ITERATION_NUMBER;
+    model.options().threadNum = threadNum;
+    model.options().engine = engine;
+    model.options().verbose = false;
+    const PointsView points = PointsView::fromDataPoints(dataPoints);
+
+    vector<float> durations;
+    int iterations = 0;
+    size_t engineMemory = 0;
+    for (int repetition = 0; repetition < WARMUP_RUNS + REPETITIONS; repetition++) {
+        KMeansRun run;
+        if (!model.fit(points, centroids, run)) return false;
+        if (repetition < WARMUP_RUNS) continue;
+        durations.push_back(run.duration);
+        iterations = run.iterations;
+        engineMemory = run.engineMemory;
+    }
+    sort(durations.begin(), durations.end());
+
+    result.version = backend.name;
+    result.kernel = backend.interleaved ? "scalar (AoS)"
+                                        : selectAssignmentKernel(dataPoints.dimension(), centroids.size()).name;
+    result.engine = backend.interleaved ? engineName(AssignmentEngine::BruteForce) : engineName(engine);
+    result.threads = threadNum;
+    result.points = dataPoints.size();
+    result.dimension = dataPoints.dimension();
+    result.clusters = static_cast<int>(centroids.size());
+    result.iterations = iterations;
+    result.medianDuration = percentile(durations, 0.5);
+    result.p95Duration = percentile(durations, 0.95);
+    result.minDuration = durations.front();
+    result.pointsPerSecond = result.medianDuration > 0
+            ? static_cast<double>(result.points) * iterations / result.medianDuration * 1000 : 0;
+    result.engineMegabytes = engineMemory / 1e6;
+    result.speedup = 0;
+    return true;
+}
+
+string jsonString(const string& value) {
+    string escaped = "\"";
+    for (char c : value) {
+        if (c == '"' || c == '\\') escaped += '\\';
+        escaped += c;
+    }
+    return escaped + "\"";
+}
+
+bool writeJsonReport(const vector<BenchResult>& results, const string& path) {
+    ofstream file(path);
+    if (!file) {
+        cerr << "Error: Unable to write " << path << endl;
+        return false;
+    }
+    file << "{\n  \"iterations\": " << ITERATION_NUMBER << ",\n  \"warmup_runs\": " << WARMUP_RUNS
+         << ",\n  \"repetitions\": " << REPETITIONS << ",\n  \"results\": [";
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& result = results[i];
+        file << (i > 0 ? "," : "") << "\n    {"
+             << "\"dataset\": " << jsonString(result.dataset)
+             << ", \"config\": " << jsonString(result.config)
+             << ", \"version\": " << jsonString(result.version)
+             << ", \"kernel\": " << jsonString(result.kernel)
+             << ", \"engine\": " << jsonString(result.engine)
+             << ", \"threads\": " << result.threads
+             << ", \"points\": " << result.points
+             << ", \"dimension\": " << result.dimension
+             << ", \"clusters\": " << result.clusters
+             << ", \"iterations\": " << result.iterations
+             << ", \"median_ms\": " << result.medianDuration
+             << ", \"p95_ms\": " << result.p95Duration
+             << ", \"min_ms\": " << result.minDuration
+             << ", \"points_per_second\": " << result.pointsPerSecond
+             << ", \"engine_mb\": " << result.engineMegabytes
+             << ", \"speedup\": " << result.speedup << "}";
+    }
+    file << "\n  ]\n}\n";
+    return static_cast<bool>(file);
+}
+
+bool writeCsvReport(const vector<BenchResult>& results, const string& path) {
+    ofstream file(path);
+    if (!file) {
+        cerr << "Error: Unable to write " << path << endl;
+        return false;
+    }
+    file << "dataset,config,version,kernel,engine,threads,points,dimension,clusters,iterations,median_ms,p95_ms,min_ms,"
+            "points_per_second,engine_mb,speedup\n";
+    for (const BenchResult& result : results) {
+        file << result.dataset << "," << result.config << "," << result.version << ",\"" << result.kernel << "\"," << result.engine << ","
+             << result.threads << "," << result.points << "," << result.dimension << "," << result.clusters << ","
+             << result.iterations << "," << result.medianDuration << "," << result.p95Duration << ","
+             << result.minDuration << "," << result.pointsPerSecond << "," << result.engineMegabytes << ","
+             << result.speedup << "\n";
+    }
+    return static_cast<bool>(file);
+}
+
+int main() {
+
+    vector<BenchResult> results;
+    for (const string& datasetPath : DATASET_PATHS) {
+        DataPoints dataPoints;
+        if (!readDatasetFromFile(dataPoints, datasetPath)) {
+            cerr << "Skipping " << datasetPath << endl;
+            continue;
+        }
+        for (const string& config : DESIRED_CONFIGS) {
+            DataPoints centroids;
+            int clusterNum;
+            if (!initializeCentroids(centroids, clusterNum, CONFIG_FILE_PATH, config, dataPoints)) {
+                cerr << "Skipping config " << config << endl;
+                continue;
+            }
+            if (!checkGemmLabels(dataPoints, centroids)) return -1;
+
+            vector<tuple<ExecutionBackend, int, AssignmentEngine>> runs;
+            if (dataPoints.dimension() <= MAX_AOS_DIMENSION) {
+                runs.emplace_back(sequentialAoSBackend(), 1, AssignmentEngine::BruteForce);
+            }
+            for (AssignmentEngine engine : ENGINES) {
+                runs.emplace_back(sequentialSoABackend(), 1, engine);
+                for (const ExecutionBackend& backend : PARALLEL_BACKENDS) {
+                    // The filtering engine needs OpenMP tasks.
+                    if (engine == AssignmentEngine::Filtering && backend.name != openMPBackend().name) continue;
+                    for (int threadNum : THREAD_COUNTS) runs.emplace_back(backend, threadNum, engine);
+                }
+            }
+
+            cout << endl << datasetPath << " [" << config << "]" << endl;
+            cout << "Version\tEngine\tThreads\tMedian (ms)\tP95 (ms)\tPoints/s\tEngine MB\tSpeedup" << endl;
+            size_t firstResult = results.size();
+            const string sequentialVersion = sequentialSoABackend().name;
+            const string sequentialEngine = engineName(AssignmentEngine::BruteForce);
+            float sequentialTime = 0;
+            for (const auto& run : runs) {
+                BenchResult result;
+                if (!benchmark(get<0>(run), get<1>(run), get<2>(run), dataPoints, centroids, result)) continue;
+                result.dataset = datasetPath;
+                result.config = config;
+                if (result.version == sequentialVersion && result.engine == sequentialEngine) {
+                    sequentialTime = result.medianDuration;
+                }
+                results.push_back(result);
+            }
+            for (size_t i = firstResult; i < results.size(); i++) {
+                BenchResult& result = results[i];
+                result.speedup = result.medianDuration > 0 ? sequentialTime / result.medianDuration : 0;
+                cout << result.version << "\t" << result.engine << "\t" << result.threads << "\t" << result.medianDuration << "\t"
+                     << result.p95Duration << "\t" << result.pointsPerSecond << "\t" << result.engineMegabytes << "\t"
+                     << result.speedup << endl;
+            }
+        }
+    }
+
+    if (results.empty()) {
+        cerr << "Error: no benchmark could run" << endl;
+        return -1;
+    }
+    if (!writeJsonReport(results, JSON_REPORT_PATH) || !writeCsvReport(results, CSV_REPORT_PATH)) return -1;
+    cout << endl << "Results written to " << JSON_REPORT_PATH << " and " << CSV_REPORT_PATH << endl;
+
+    return 0;
+}
@@ -0,0 +1,166 @@
+#include <iostream>
+#include "INIReader.h"
+#include "dataset_sampler.h"
+#include "assignment_kernel.h"
+#include "seeding.h"
+#include "centroid_config.h"
+#include "cluster_accumulators.h"
+#include <vector>
+#include <chrono>
+#include <random>
+#include <omp.h>
+
+using namespace std;
+using namespace chrono;
+
+static const string DATASET_PATH = "../datasets/generated_blob_dataset_400k.csv";
+static const string CONFIG_FILE_PATH = "../config_files/config_sets.ini";
+static const string DESIRED_CONFIG = "4_cluster";
+// Where the final centroids are saved for k_means_predict, e.g.
+// "trained_centroids.ini"; empty (the default) to skip.
+static const string TRAINED_CENTROIDS_PATH = "";
+// Defaults, overridden by the batch_size and batch_num keys of the config section.
+static const int BATCH_SIZE = 4096;
+static const int BATCH_NUMBER = 200;
+static const int THREAD_NUMBER = 16;
+static const uint64_t SAMPLING_SEED = 42;
+// Points drawn from the file to pick the centroids when init is not "config".
+static const size_t SEEDING_SAMPLE_SIZE = 1 << 16;
+
+bool initializeCentroids(DataPoints& centroids, int& clusterNum, int& batchSize, int& batchNum,
+                         const string& configFilePath, const string& desiredConfig, const DatasetSampler& sampler) {
+    INIReader reader(configFilePath);
+    if (reader.ParseError() < 0) {
+        cerr << "Error loading config file\n";
+        return false;
+    }
+    clusterNum = reader.GetInteger(desiredConfig, "cluster_num", 0);
+    batchSize = reader.GetInteger(desiredConfig, "batch_size", BATCH_SIZE);
+    batchNum = reader.GetInteger(desiredConfig, "batch_num", BATCH_NUMBER);
+    if (batchSize <= 0 || batchNum <= 0) {
+        cerr << "Error: batch_size and batch_num must be positive" << endl;
+        return false;
+    }
+    SeedingOptions seeding;
+    if (!readSeedingOptions(reader, desiredConfig, clusterNum, seeding)) return false;
+    if (seeding.method != SeedingMethod::Config) {
+        auto startTime = high_resolution_clock::now();
+        mt19937_64 generator(seeding.seed);
+        DataPoints sample;
+        if (!sampler.sample(generator, max(SEEDING_SAMPLE_SIZE, static_cast<size_t>(clusterNum)), sample)) {
+            cerr << "Error: no valid point in the dataset" << endl;
+            return false;
+        }
+        if (!seedCentroids(sample, seeding, centroids)) return false;
+        auto endTime = high_resolution_clock::now();
+        auto time = duration_cast<microseconds>(endTime - startTime).count() / 1000.f;
+        cout << "Seeding (" << seedingMethodName(seeding.method) << ", " << sample.size() << " sampled points): "
+             << time << " ms" << endl;
+        return true;
+    }
+    return readConfigCentroids(reader, desiredConfig, clusterNum, sampler.dimension(), centroids);
+}
+
+int main() {
+
+    DatasetSampler sampler(DATASET_PATH);
+    if (!sampler.isOpen()) return -1;
+    cout << "Sampling " << (sampler.isBinary() ? "binary" : "CSV") << " dataset " << DATASET_PATH << endl;
+    DataPoints centroids;
+    int clusterNum;
+    int batchSize;
+    int batchNum;
+    if (!initializeCentroids(centroids, clusterNum, batchSize, batchNum, CONFIG_FILE_PATH, DESIRED_CONFIG, sampler)) return -1;
+
+    printCentroids(centroids);
+    const int dimension = sampler.dimension();
+    const AssignmentKernel kernel = selectAssignmentKernel(dimension, clusterNum);
+    const vector<const float*> centroidColumns = centroids.columnData();
+    cout << "Assignment kernel: " << kernel.name << endl;
+    cout << "Batches: " << batchNum << " x " << batchSize << " points" << endl;
+
+    // Every step runs THREAD_NUMBER batches against the same centroids, one
+    // per thread, then folds them in with per-centroid learning rates
+    // (Sculley, "Web-scale k-means clustering"): a centroid that has seen n
+    // points moves towards a batch mean of m points by m / (n + m).
+    ClusterAccumulators accumulators(THREAD_NUMBER, dimension, clusterNum);
+    vector<double> seenPoints(clusterNum, 0);
+    vector<int> batchClustersSize(clusterNum);
+    bool failed = false;
+
+    auto startTime = high_resolution_clock::now();
+#pragma omp parallel num_threads(THREAD_NUMBER) default(none) shared(sampler,centroids,clusterNum,dimension,batchSize,batchNum,kernel,centroidColumns,ASSIGNMENT_BLOCK_SIZE,accumulators,seenPoints,batchClustersSize,failed)
+    {
+        // The team may get fewer than THREAD_NUMBER threads: each thread then
+        // draws the batches of several accumulator slots, so that every
+        // slot is filled and the result does not depend on the team size.
+        const int thread = omp_get_thread_num();
+        const int teamSize = omp_get_num_threads();
+        vector<float*> sums(dimension);
+        int labels[ASSIGNMENT_BLOCK_SIZE];
+        DataPoints batch;
+        vector<float> newCentroid(dimension);
+        for (int firstBatch = 0; firstBatch < batchNum; firstBatch += THREAD_NUMBER) {
+            for (int slot = thread; slot < THREAD_NUMBER; slot += teamSize) {
+                accumulators.clear(slot);
+                for (int d = 0; d < dimension; d++) sums[d] = accumulators.sums(slot, d);
+                int* clustersSize = accumulators.sizes(slot);
+
+                // Batch b always uses the same random stream, whichever thread draws it.
+                const int batchIndex = firstBatch + slot;
+                if (batchIndex >= batchNum) continue;
+                seed_seq seed{SAMPLING_SEED, static_cast<uint64_t>(batchIndex)};
+                mt19937_64 generator(seed);
+                if (!sampler.sample(generator, batchSize, batch)) {
+#pragma omp atomic write
+                    failed = true;
+                    batch.resize(0);
+                }
+                const vector<const float*> batchColumns = batch.columnData();
+                for (size_t block = 0; block < batch.size(); block += ASSIGNMENT_BLOCK_SIZE) {
+                    size_t blockSize = min(ASSIGNMENT_BLOCK_SIZE, batch.size() - block);
+                    kernel.assign(batchColumns.data(), block, blockSize, centroidColumns.data(), dimension, clusterNum,
+                                  labels);
+                    kernel.accumulate(batchColumns.data(), block, blockSize, labels, dimension, sums.data(), clustersSize);
+                }
+            }
+#pragma omp barrier
+
+#pragma omp for schedule(static)
+            for (int i = 0; i < clusterNum; i++) {
+                accumulators.merge(i, newCentroid.data(), batchClustersSize[i]);
+                if (batchClustersSize[i] == 0) continue;
+                seenPoints[i] += batchClustersSize[i];
+                float learningRate = static_cast<float>(batchClustersSize[i] / seenPoints[i]);
+                for (int d = 0; d < dimension; d++) {
+                    centroids[d][i] += learningRate * (newCentroid[d] / batchClustersSize[i] - centroids[d][i]);
+                }
+            }
+        }
+    }
+    auto endTime = high_resolution_clock::now();
+    if (failed) {
+        cerr << "Error: no valid point in the dataset" << endl;
+        return -1;
+    }
+
+    auto time = duration_cast<microseconds>(endTime - startTime).count() / 1000.f;
+    double processedPoints = static_cast<double>(batchNum) * batchSize;
+    cout << endl;
+    for (int i = 0; i < clusterNum; i++) {
+        cout << "Cluster" << i + 1 << " points seen: " << static_cast<size_t>(seenPoints[i]) << endl;
+    }
+    cout << endl;
+    printCentroids(centroids);
+    cout << "Processed " << static_cast<size_t>(processedPoints) << " points in " << time << " ms";
+    if (time > 0) cout << " (" << processedPoints / time * 1000 << " points/s)";
+    cout << endl;
+    cout << "Duration: " << time << " ms" << endl;
+
+    if (!TRAINED_CENTROIDS_PATH.empty() &&
+        writeCentroids(centroids, TRAINED_CENTROIDS_PATH, TRAINED_CENTROIDS_SECTION)) {
+        cout << "Centroids saved to " << TRAINED_CENTROIDS_PATH << endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,209 @@
+#include <iostream>
+#include "dataset_loader.h"
+#include "assignment_kernel.h"
+#include "centroid_config.h"
+#include "dataset_sampler.h"
+#include "lloyd.h"
+#include "seeding.h"
+#include <chrono>
+#include <random>
+#include <vector>
+#include <mpi.h>
+
+using namespace std;
+using namespace chrono;
+
+static const string DATASET_PATH = "../datasets/generated_blob_dataset_400k.csv";
+static const string CONFIG_FILE_PATH = "../config_files/config_sets.ini";
+static const string DESIRED_CONFIG = "4_cluster";
+// Where rank 0 saves the final centroids for k_means_predict, e.g.
+// "trained_centroids.ini"; empty (the default) to skip.
+static const string TRAINED_CENTROIDS_PATH = "";
+static const int ITERATION_NUMBER = 10;
+static const bool STOP_ON_CONVERGENCE = false;
+static const float CONVERGENCE_TOLERANCE = 1e-4f;
+// Threads per rank: `mpirun -np N` gives the centroids of k_means_parallel
+// with N * THREAD_NUMBER threads.
+static const int THREAD_NUMBER = 4;
+// Filtering needs the whole dataset in one process.
+static const AssignmentEngine ASSIGNMENT_ENGINE = AssignmentEngine::BruteForce;
+// Points drawn from the file to pick the centroids when init is not "config".
+static const size_t SEEDING_SAMPLE_SIZE = 1 << 16;
+
+// True on every rank if `succeeded` holds on all of them, so that no rank
+// waits forever in a collective call another one never reaches.
+bool allRanks(bool succeeded) {
+    int value = succeeded;
+    MPI_Allreduce(MPI_IN_PLACE, &value, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+    return value != 0;
+}
+
+// No rank holds the whole dataset, so the centroids are seeded from a sample
+// drawn from the file. The generator is seeded from the config, so every rank
+// draws the same sample and picks the same centroids.
+bool initializeCentroids(DataPoints& centroids, int& clusterNum, const string& configFilePath,
+                         const string& desiredConfig, const DatasetSampler& sampler) {
+    INIReader reader(configFilePath);
+    if (reader.ParseError() < 0) {
+        cerr << "Error loading config file\n";
+        return false;
+    }
+    clusterNum = reader.GetInteger(desiredConfig, "cluster_num", 0);
+    SeedingOptions seeding;
+    if (!readSeedingOptions(reader, desiredConfig, clusterNum, seeding)) return false;
+    if (seeding.method != SeedingMethod::Config) {
+        auto startTime = high_resolution_clock::now();
+        mt19937_64 generator(seeding.seed);
+        DataPoints sample;
+        if (!sampler.sample(generator, max(SEEDING_SAMPLE_SIZE, static_cast<size_t>(clusterNum)), sample)) {
+            cerr << "Error: no valid point in the dataset" << endl;
+            return false;
+        }
+        if (!seedCentroids(sample, seeding, centroids)) return false;
+        auto endTime = high_resolution_clock::now();
+        auto time = duration_cast<microseconds>(endTime - startTime).count() / 1000.f;
+        cout << "Seeding (" << seedingMethodName(seeding.method) << ", " << sample.size() << " sampled points): "
+             << time << " ms" << endl;
+        return true;
+    }
+    return readConfigCentroids(reader, desiredConfig, clusterNum, sampler.dimension(), centroids);
+}
+
+// Moves the rows of `part`, which start at row partFirst[rank] of the
+// dataset, to the ranks whose shardRows() hold them, and returns the rows of
+// this rank.
+DataPoints exchangeRows(const DataPoints& part, const vector<size_t>& partFirst, size_t pointNum, int rank,
+                        int rankNum) {
+    const auto rows = shardRows(pointNum, rank, rankNum, THREAD_NUMBER);
+    vector<int> sendCounts(rankNum, 0), sendOffsets(rankNum, 0), receiveCounts(rankNum, 0), receiveOffsets(rankNum, 0);
+    for (int other = 0; other < rankNum; other++) {
+        const auto otherRows = shardRows(pointNum, other, rankNum, THREAD_NUMBER);
+        size_t first = max(partFirst[rank], otherRows.first);
+        size_t last = min(partFirst[rank + 1], otherRows.first + otherRows.second);
+        if (first < last) {
+            sendCounts[other] = static_cast<int>(last - first);
+            sendOffsets[other] = static_cast<int>(first - partFirst[rank]);
+        }
+        first = max(partFirst[other], rows.first);
+        last = min(partFirst[other + 1], rows.first + rows.second);
+        if (first < last) {
+            receiveCounts[other] = static_cast<int>(last - first);
+            receiveOffsets[other] = static_cast<int>(first - rows.first);
+        }
+    }
+    DataPoints shard(part.dimension());
+    shard.resize(rows.second);
+    for (int d = 0; d < part.dimension(); d++) {
+        MPI_Alltoallv(part[d].data(), sendCounts.data(), sendOffsets.data(), MPI_FLOAT, shard[d].data(),
+                      receiveCounts.data(), receiveOffsets.data(), MPI_FLOAT, MPI_COMM_WORLD);
+    }
+    return shard;
+}
+
+ShardExchange mpiExchange(int rank, int rankNum) {
+    ShardExchange exchange;
+    exchange.shard = rank;
+    exchange.shardNum = rankNum;
+    exchange.gatherFloats = [](float* values, size_t size) {
+        MPI_Allgather(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, values, static_cast<int>(size), MPI_FLOAT, MPI_COMM_WORLD);
+    };
+    exchange.gatherInts = [](int* values, size_t size) {
+        MPI_Allgather(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, values, static_cast<int>(size), MPI_INT, MPI_COMM_WORLD);
+    };
+    exchange.sum = [](size_t* values, int count) {
+        vector<unsigned long long> sums(values, values + count);
+        MPI_Allreduce(MPI_IN_PLACE, sums.data(), count, MPI_UNSIGNED_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+        for (int i = 0; i < count; i++) values[i] = sums[i];
+    };
+    return exchange;
+}
+
+int runKMeans(int rank, int rankNum) {
+
+    // Every rank reads only its part of the file. The parts follow the bytes
+    // of a CSV file, not its rows, so their rows are then moved to the ranks
+    // whose shards hold them.
+    DataPoints part;
+    if (!allRanks(readDatasetPart(part, DATASET_PATH, rank, rankNum))) return -1;
+    int dimension = part.dimension();
+    MPI_Allreduce(MPI_IN_PLACE, &dimension, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+    if (dimension == 0) {
+        cerr << "Error: No coordinates found in " << DATASET_PATH << endl;
+        return -1;
+    }
+    if (!allRanks(part.dimension() == 0 || part.dimension() == dimension)) {
+        cerr << "Error: the parts of " << DATASET_PATH << " have different dimensions" << endl;
+        return -1;
+    }
+    if (part.dimension() == 0) part = DataPoints(dimension);
+    vector<unsigned long long> partSizes(rankNum);
+    partSizes[rank] = part.size();
+    MPI_Allgather(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, partSizes.data(), 1, MPI_UNSIGNED_LONG_LONG, MPI_COMM_WORLD);
+    vector<size_t> partFirst(rankNum + 1, 0);
+    for (int other = 0; other < rankNum; other++) partFirst[other + 1] = partFirst[other] + partSizes[other];
+    const size_t pointNum = partFirst[rankNum];
+    DataPoints dataPoints = exchangeRows(part, partFirst, pointNum, rank, rankNum);
+    part = DataPoints();
+
+    DatasetSampler sampler(DATASET_PATH);
+    if (!allRanks(sampler.isOpen())) return -1;
+    DataPoints centroids;
+    int clusterNum;
+    if (!allRanks(initializeCentroids(centroids, clusterNum, CONFIG_FILE_PATH, DESIRED_CONFIG, sampler))) {
+        return -1;
+    }
+
+    printCentroids(centroids);
+    cout << "Assignment kernel: " << selectAssignmentKernel(dataPoints.dimension(), clusterNum).name << endl;
+    cout << pointNum << " points split across " << rankNum << " processes of " << THREAD_NUMBER << " threads" << endl;
+
+    LloydOptions options;
+    options.iterationNum = ITERATION_NUMBER;
+    options.stopOnConvergence = STOP_ON_CONVERGENCE;
+    options.convergenceTolerance = CONVERGENCE_TOLERANCE;
+    options.engine = ASSIGNMENT_ENGINE;
+    options.threadNum = THREAD_NUMBER;
+    KMeansRun run = kMeansDistributed(dataPoints, pointNum, centroids, options, mpiExchange(rank, rankNum));
+    if (run.iterations == 0 && ITERATION_NUMBER > 0) return -1;
+
+    // The slowest rank sets the pace.
+    float duration = run.duration;
+    MPI_Reduce(&run.duration, &duration, 1, MPI_FLOAT, MPI_MAX, 0, MPI_COMM_WORLD);
+    cout << "Duration: " << duration << " ms" << endl;
+    if (STOP_ON_CONVERGENCE) {
+        if (run.converged) {
+            cout << "Converged after " << run.iterations << " iterations in " << duration << " ms" << endl;
+        } else {
+            cout << "Not converged after " << run.iterations << " iterations" << endl;
+        }
+    }
+
+    if (rank == 0 && !TRAINED_CENTROIDS_PATH.empty() &&
+        writeCentroids(centroids, TRAINED_CENTROIDS_PATH, TRAINED_CENTROIDS_SECTION)) {
+        cout << "Centroids saved to " << TRAINED_CENTROIDS_PATH << endl;
+    }
+
+    return 0;
+}
+
+int main(int argc, char** argv) {
+
+    // Only the master thread of each rank calls MPI.
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+    int rank;
+    int rankNum;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &rankNum);
+    // Rank 0 prints the report; errors still reach stderr from any rank.
+    if (rank != 0) cout.setstate(ios::badbit);
+
+    int status = -1;
+    if (provided < MPI_THREAD_FUNNELED) {
+        cerr << "Error: the MPI library does not support OpenMP threads" << endl;
+    } else {
+        status = runKMeans(rank, rankNum);
+    }
+    MPI_Finalize();
+    return status;
+}
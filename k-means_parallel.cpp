@@ -1,10 +1,15 @@
 #include <iostream>
-#include "INIReader.h"
-#include <fstream>
-#include <sstream>
-#include <vector>
+#include "dataset_loader.h"
+#include "assignment_kernel.h"
+#include "centroid_config.h"
+#include "coreset.h"
+#include "deduplication.h"
+#include "kmeans_model.h"
+#include "memory_placement.h"
+#include "pipelined_loader.h"
+#include "seeding.h"
 #include <chrono>
-#include <cmath>
+#include <vector>
 
 using namespace std;
 using namespace chrono;
@@ -12,157 +17,288 @@ using namespace chrono;
 static const string DATASET_PATH = "../datasets/generated_blob_dataset_400k.csv";
 static const string CONFIG_FILE_PATH = "../config_files/config_sets.ini";
 static const string DESIRED_CONFIG = "4_cluster";
+// Where the final centroids are saved for k_means_predict, e.g.
+// "trained_centroids.ini"; empty (the default) to skip.
+static const string TRAINED_CENTROIDS_PATH = "";
 static const int ITERATION_NUMBER = 10;
+static const bool STOP_ON_CONVERGENCE = false;
+static const float CONVERGENCE_TOLERANCE = 1e-4f;
 static const int THREAD_NUMBER = 16;
+static const AssignmentEngine ASSIGNMENT_ENGINE = AssignmentEngine::BruteForce;
+static const bool SCALING_REPORT = false;
+// Prints the cluster sizes and centroids after every iteration.
+static const bool VERBOSE = true;
+// Phase times of every iteration and thread (iteration_metrics.h), saved as
+// JSON lines and CSV; empty paths to skip.
+static const string METRICS_JSON_PATH = "";
+static const string METRICS_CSV_PATH = "";
+// Also counts cycles, instructions and cache misses through perf_event_open.
+static const bool HARDWARE_COUNTERS = false;
+// Above 1, fits this many restarts in one pass over the points instead
+// (kMeansRestarts) and keeps the one with the lowest inertia. The first starts
+// from the config centroids, the others from RESTART_SEEDING with seeds 1, 2...
+static const int RESTART_NUMBER = 1;
+static const SeedingMethod RESTART_SEEDING = SeedingMethod::KMeansPlusPlus;
+// Also fits the restarts one at a time and compares the durations.
+static const bool RESTART_COMPARISON = false;
+// Pins the threads and copies the points so that the rows of each thread are
+// first touched by it, i.e. live on its NUMA node (memory_placement.h).
+static const bool NUMA_PLACEMENT = true;
+static const HugePages HUGE_PAGES = HugePages::Transparent;
+// Also runs the k-means on the layout left by the loader, before placing the
+// points, and compares the two durations.
+static const bool PLACEMENT_COMPARISON = false;
+// Computes the first iteration while the dataset is being parsed; needs the
+// centroids from the config file.
+static const bool PIPELINED_LOAD = false;
+// Also loads the dataset normally and runs one iteration, to measure how
+// much time the pipeline hides.
+static const bool PIPELINE_COMPARISON = false;
+// Runs the iterations on a persistent std::thread pool with work stealing
+// instead of an OpenMP parallel region.
+static const bool WORKER_POOL = false;
+// Above 0, fits a weighted coreset of about this many points instead
+// (coreset.h), then the whole dataset from the same centroids, and compares
+// the cost of the two solutions on the whole dataset.
+static const size_t CORESET_SIZE = 0;
+static const uint64_t CORESET_SEED = 42;
+// Collapses the rows that fall in the same cell of a grid with side
+// DEDUPLICATION_QUANTUM (0: identical rows) into weighted points and runs the
+// iterations on those (deduplication.h); cluster sizes count the rows.
+static const bool DEDUPLICATE = false;
+static const float DEDUPLICATION_QUANTUM = 0;
 
-struct DataPoints {
-    std::vector<float>
-            xs;
-    std::vector<float> ys;
-    std::vector<float> zs;
-};
+int main() {
 
-void printCentroids(DataPoints& centroids) {
-    for (int i=0; i<centroids.xs.size(); i++) {
-        cout << "(" << centroids.xs[i] << ", " << centroids.ys[i] << ", " << centroids.zs[i] << ")" << endl;
+    DataPoints dataPoints;
+    DataPoints centroids;
+    int clusterNum;
+    int iterationNum = ITERATION_NUMBER;
+    if (PIPELINED_LOAD) {
+        if (!initializeCentroids(centroids, clusterNum, CONFIG_FILE_PATH, DESIRED_CONFIG, dataPoints)) return -1;
+        printCentroids(centroids);
+        PipelineReport report;
+        if (!loadWithFirstIteration(dataPoints, DATASET_PATH, centroids, THREAD_NUMBER, report)) return -1;
+        iterationNum--;
+        cout << "Pipelined load of " << dataPoints.size() << " points: " << report.duration << " ms (read "
+             << report.readTime << " ms; per worker, parse " << report.parseTime << " ms and first iteration "
+             << report.assignmentTime << " ms)" << endl;
+        if (PIPELINE_COMPARISON) {
+            DataPoints loaded;
+            DataPoints firstCentroids;
+            auto startTime = high_resolution_clock::now();
+            if (!readDatasetFromFile(loaded, DATASET_PATH)) return -1;
+            auto loadedTime = high_resolution_clock::now();
+            if (!initializeCentroids(firstCentroids, clusterNum, CONFIG_FILE_PATH, DESIRED_CONFIG, loaded)) return -1;
+            LloydOptions options;
+            options.iterationNum = 1;
+            options.threadNum = THREAD_NUMBER;
+            options.verbose = false;
+            auto iterationStart = high_resolution_clock::now();
+            kMeansParallel(loaded, firstCentroids, options);
+            auto endTime = high_resolution_clock::now();
+            const float sequentialTime =
+                    duration_cast<microseconds>(loadedTime - startTime + endTime - iterationStart).count() / 1000.f;
+            const float loadTime = duration_cast<microseconds>(loadedTime - startTime).count() / 1000.f;
+            // Negative when the pipeline is slower, e.g. with no spare core.
+            const float hiddenTime = sequentialTime - report.duration;
+            cout << "Load then first iteration: " << sequentialTime << " ms; hidden " << hiddenTime << " ms ("
+                 << 100 * hiddenTime / loadTime << "% of the load)" << endl;
+        }
+    } else {
+        if(!readDatasetFromFile(dataPoints, DATASET_PATH)) return -1;
+        if (!initializeCentroids(centroids, clusterNum, CONFIG_FILE_PATH, DESIRED_CONFIG, dataPoints)) return -1;
+        printCentroids(centroids);
+    }
+
+    cout << "Assignment kernel: " << selectAssignmentKernel(dataPoints.dimension(), clusterNum).name << endl;
+
+    KMeansModel model(WORKER_POOL ? workerPoolBackend() : openMPBackend());
+    cout << "Backend: " << model.backend().name << endl;
+    model.options().iterationNum = iterationNum;
+    model.options().stopOnConvergence = STOP_ON_CONVERGENCE;
+    model.options().convergenceTolerance = CONVERGENCE_TOLERANCE;
+    model.options().engine = ASSIGNMENT_ENGINE;
+    model.options().threadNum = THREAD_NUMBER;
+    model.options().verbose = VERBOSE;
+    model.options().firstIterationNumber = ITERATION_NUMBER - iterationNum + 1;
+    IterationMetrics metrics(HARDWARE_COUNTERS);
+    if (!METRICS_JSON_PATH.empty() || !METRICS_CSV_PATH.empty()) model.options().metrics = &metrics;
+    if (HARDWARE_COUNTERS && !hardwareCountersAvailable()) {
+        cerr << "Warning: hardware counters unavailable, only the phase times are measured" << endl;
     }
-}
 
-bool readDatasetFromFile(DataPoints& dataset, const string& fullPath) {
-    ifstream file(fullPath);
-    if (file.is_open()) {
-        string line;
-        cout << "Reading the dataset..." << endl;
-        while (getline(file, line)) {
-            istringstream coordinates(line);
-            float x;
-            float y;
-            float z;
-            char delimiter1;
-            char delimiter2;
-            if (coordinates >> x >> delimiter1 >> y >> delimiter2 >> z) {
-                dataset.xs.push_back(x);
-                dataset.ys.push_back(y);
-                dataset.zs.push_back(z);
+    float loaderLayoutTime = 0;
+    if (NUMA_PLACEMENT) {
+        if (PLACEMENT_COMPARISON) {
+            model.options().verbose = false;
+            // The first run only pages the dataset in.
+            for (int repetition = 0; repetition < 2; repetition++) {
+                KMeansRun run;
+                if (!model.fit(PointsView::fromDataPoints(dataPoints), centroids, run)) return -1;
+                loaderLayoutTime = run.duration;
             }
+            model.options().verbose = VERBOSE;
+            cout << "Loader layout (" << pagePlacement(dataPoints) << "): " << loaderLayoutTime << " ms" << endl;
         }
-        file.close();
-        cout << "Dataset loaded from " << fullPath << endl;
-        return true;
-    } else {
-        cerr << "Error: Unable to open file " << fullPath << endl;
-        return false;
+        if (!pinThreads(THREAD_NUMBER) || !placeForThreads(dataPoints, THREAD_NUMBER, HUGE_PAGES)) return -1;
+        cout << "Points placed for " << THREAD_NUMBER << " pinned threads with " << hugePagesName(HUGE_PAGES)
+             << " huge pages (" << pagePlacement(dataPoints) << ")" << endl;
     }
-}
+    const PointsView points = PointsView::fromDataPoints(dataPoints);
 
-bool initializeCentroids(DataPoints& centroids, int& clusterNum, const string& configFilePath, const string& desiredConfig) {
-    INIReader reader(configFilePath);
-    if (reader.ParseError() < 0) {
-        cerr << "Error loading config file\n";
-        return false;
+    if (RESTART_NUMBER > 1) {
+        vector<DataPoints> restarts(1, centroids);
+        for (int restart = 1; restart < RESTART_NUMBER; restart++) {
+            SeedingOptions seeding;
+            seeding.method = RESTART_SEEDING;
+            seeding.clusterNum = clusterNum;
+            seeding.seed = restart;
+            restarts.emplace_back();
+            if (!seedCentroids(dataPoints, seeding, restarts.back())) return -1;
+        }
+        float separateTime = 0;
+        if (RESTART_COMPARISON) {
+            model.options().verbose = false;
+            for (const auto& restart : restarts) {
+                KMeansRun run;
+                if (!model.fit(points, restart, run)) return -1;
+                separateTime += run.duration;
+            }
+        }
+        vector<RestartResult> results;
+        KMeansRun run = kMeansRestarts(dataPoints, restarts, model.options(), results);
+        cout << endl << "Restart\tInertia\tIterations" << endl;
+        for (int restart = 0; restart < RESTART_NUMBER; restart++) {
+            cout << restart << "\t" << results[restart].inertia << "\t" << results[restart].iterations
+                 << (results[restart].converged ? " (converged)" : "") << endl;
+        }
+        const int best = bestRestart(results);
+        cout << "Best restart: " << best << endl;
+        printCentroids(restarts[best]);
+        cout << RESTART_NUMBER << " restarts in one pass: " << run.duration << " ms" << endl;
+        if (separateTime > 0) {
+            cout << "One at a time: " << separateTime << " ms, speedup " << separateTime / run.duration << endl;
+        }
+        if (!TRAINED_CENTROIDS_PATH.empty() &&
+            writeCentroids(restarts[best], TRAINED_CENTROIDS_PATH, TRAINED_CENTROIDS_SECTION)) {
+            cout << "Centroids saved to " << TRAINED_CENTROIDS_PATH << endl;
+        }
+        return 0;
     }
-    clusterNum = reader.GetInteger(desiredConfig, "cluster_num", 0);
-    for(int i=0; i < clusterNum; i++)  {
-        istringstream coordinates(reader.Get(desiredConfig, "centroid" + to_string(i), ""));
-        float x;
-        float y;
-        float z;
-        char delimiter1;
-        char delimiter2;
-        if (coordinates >> x >> delimiter1 >> y >> delimiter2 >> z){
-            centroids.xs.push_back(x);
-            centroids.ys.push_back(y);
-            centroids.zs.push_back(z);
+
+    if (CORESET_SIZE > 0) {
+        CoresetOptions coresetOptions;
+        coresetOptions.size = CORESET_SIZE;
+        coresetOptions.seed = CORESET_SEED;
+        coresetOptions.threadNum = THREAD_NUMBER;
+        Coreset coreset;
+        auto startTime = high_resolution_clock::now();
+        if (!buildCoreset(dataPoints, coresetOptions, coreset)) return -1;
+        auto endTime = high_resolution_clock::now();
+        const float buildTime = duration_cast<microseconds>(endTime - startTime).count() / 1000.f;
+        double totalWeight = 0;
+        for (float weight : coreset.weights) totalWeight += weight;
+        cout << "Coreset of " << coreset.points.size() << " points (total weight " << totalWeight << ") built in "
+             << buildTime << " ms" << endl;
+
+        DataPoints coresetCentroids = centroids;
+        KMeansRun coresetRun = kMeansWeighted(coreset.points, coreset.weights, coresetCentroids, model.options());
+        model.options().verbose = false;
+        KMeansRun fullRun;
+        if (!model.fit(points, centroids, fullRun)) return -1;
+        const double coresetCost = clusteringCost(dataPoints, coresetCentroids, THREAD_NUMBER);
+        const double fullCost = clusteringCost(dataPoints, model.centroids(), THREAD_NUMBER);
+        cout << "Coreset fit: " << coresetRun.duration << " ms (" << buildTime + coresetRun.duration
+             << " ms with the build), full fit: " << fullRun.duration << " ms" << endl;
+        cout << "Cost on the whole dataset: coreset " << coresetCost << ", full " << fullCost << ", ratio "
+             << coresetCost / fullCost << endl;
+        if (!TRAINED_CENTROIDS_PATH.empty() &&
+            writeCentroids(coresetCentroids, TRAINED_CENTROIDS_PATH, TRAINED_CENTROIDS_SECTION)) {
+            cout << "Centroids saved to " << TRAINED_CENTROIDS_PATH << endl;
         }
+        return 0;
     }
-    return true;
-}
 
-int main() {
+    if (DEDUPLICATE) {
+        DeduplicationOptions deduplication;
+        deduplication.quantum = DEDUPLICATION_QUANTUM;
+        deduplication.threadNum = THREAD_NUMBER;
+        DeduplicatedPoints deduplicated;
+        auto startTime = high_resolution_clock::now();
+        if (!deduplicatePoints(dataPoints, deduplication, deduplicated)) return -1;
+        auto endTime = high_resolution_clock::now();
+        cout << "Deduplicated " << dataPoints.size() << " rows into " << deduplicated.points.size() << " points in "
+             << duration_cast<microseconds>(endTime - startTime).count() / 1000.f << " ms" << endl;
 
-    DataPoints dataPoints;
-    if(!readDatasetFromFile(dataPoints, DATASET_PATH)) return -1;
-    DataPoints centroids;
-    int clusterNum;
-    if (!initializeCentroids(centroids, clusterNum, CONFIG_FILE_PATH, DESIRED_CONFIG)) return -1;
-    vector<int> totalClustersSize(clusterNum);
-
-
-    printCentroids(centroids);
-
-    auto startTime = high_resolution_clock::now();
-#pragma omp parallel num_threads(THREAD_NUMBER) default(none) shared(dataPoints,centroids,clusterNum,cout,totalClustersSize)
-    {
-        for (int iteration = 0; iteration < ITERATION_NUMBER; iteration++) {
-#pragma omp master
-            cout << endl << "Iteration " << iteration + 1 << ":" << endl;
-
-            DataPoints newCentroids;
-            vector<int> clustersSize(clusterNum);
-            vector<float> defaultCoordinate(clusterNum);
-            newCentroids.xs.insert(newCentroids.xs.end(), defaultCoordinate.begin(), defaultCoordinate.end());
-            newCentroids.ys.insert(newCentroids.ys.end(), defaultCoordinate.begin(), defaultCoordinate.end());
-            newCentroids.zs.insert(newCentroids.zs.end(), defaultCoordinate.begin(), defaultCoordinate.end());
-
-#pragma omp for schedule(static)
-            for (int i = 0; i < dataPoints.xs.size(); i++) {
-                float shortestDistance = sqrt(
-                        pow(centroids.xs[0] - dataPoints.xs[i], 2) + pow(centroids.ys[0] - dataPoints.ys[i], 2) +
-                        pow(centroids.zs[0] - dataPoints.zs[i], 2));
-                int clusterType = 0;
-                for (int j = 1; j < clusterNum; j++) {
-                    float centroidDistance = sqrt(
-                            pow(centroids.xs[j] - dataPoints.xs[i], 2) + pow(centroids.ys[j] - dataPoints.ys[i], 2) +
-                            pow(centroids.zs[j] - dataPoints.zs[i], 2));
-                    if (centroidDistance < shortestDistance) {
-                        shortestDistance = centroidDistance;
-                        clusterType = j;
-                    }
-                }
-                newCentroids.xs[clusterType] += dataPoints.xs[i];
-                newCentroids.ys[clusterType] += dataPoints.ys[i];
-                newCentroids.zs[clusterType] += dataPoints.zs[i];
-                clustersSize[clusterType]++;
-            }
+        // The sizes come from the assignment the final centroids were computed
+        // from, as in the other runs.
+        vector<int> pointLabels;
+        KMeansRun run =
+                kMeansWeighted(deduplicated.points, deduplicated.weights, centroids, model.options(), &pointLabels);
+        cout << "Duration: " << run.duration << " ms" << endl;
+        vector<int> labels;
+        expandLabels(deduplicated, pointLabels.data(), THREAD_NUMBER, labels);
+        vector<size_t> clusterSizes(clusterNum, 0);
+        for (int label : labels) clusterSizes[label]++;
+        for (int i = 0; i < clusterNum; i++) cout << "Cluster" << i + 1 << " size: " << clusterSizes[i] << endl;
+        if (!TRAINED_CENTROIDS_PATH.empty() &&
+            writeCentroids(centroids, TRAINED_CENTROIDS_PATH, TRAINED_CENTROIDS_SECTION)) {
+            cout << "Centroids saved to " << TRAINED_CENTROIDS_PATH << endl;
+        }
+        return 0;
+    }
 
-#pragma omp single
-            {
-                for(int i = 0; i < clusterNum; i++){
-                    centroids.xs[i] = 0;
-                    centroids.ys[i] = 0;
-                    centroids.zs[i] = 0;
-                }
-            }
+    if (SCALING_REPORT) {
+        cout << endl << "Threads\tDuration (ms)\tSpeedup\tEfficiency" << endl;
+        vector<int> threadCounts;
+        for (int threadNum = 1; threadNum < THREAD_NUMBER; threadNum *= 2) threadCounts.push_back(threadNum);
+        threadCounts.push_back(THREAD_NUMBER);
+        model.options().verbose = false;
+        float sequentialTime = 0;
+        for (int threadNum : threadCounts) {
+            model.options().threadNum = threadNum;
+            KMeansRun run;
+            if (!model.fit(points, centroids, run)) return -1;
+            float time = run.duration;
+            if (threadNum == 1) sequentialTime = time;
+            cout << threadNum << "\t" << time << "\t" << sequentialTime / time << "\t" << sequentialTime / time / threadNum << endl;
+        }
+        return 0;
+    }
 
-            for (int i = 0; i < clusterNum; i++) {
-#pragma omp atomic
-                centroids.xs[i] += newCentroids.xs[i];
-#pragma omp atomic
-                centroids.ys[i] += newCentroids.ys[i];
-#pragma omp atomic
-                centroids.zs[i] += newCentroids.zs[i];
-#pragma omp atomic
-                totalClustersSize[i] += clustersSize[i];
-            }
-#pragma omp barrier
-#pragma omp single
-            {
-                cout << endl;
-                for (int i = 0; i < clusterNum; i++) {
-                    cout << "Cluster" << i + 1 << " size: " << totalClustersSize[i] << endl;
-                    centroids.xs[i] = centroids.xs[i] / totalClustersSize[i];
-                    centroids.ys[i] = centroids.ys[i] / totalClustersSize[i];
-                    centroids.zs[i] = centroids.zs[i] / totalClustersSize[i];
-                    totalClustersSize[i] = 0;
-                }
-                cout << endl;
-                printCentroids(centroids);
-            }
+    KMeansRun run;
+    if (!model.fit(points, centroids, run)) return -1;
+    cout << "Duration: " << run.duration << " ms" << endl;
+    if (model.options().metrics) {
+        cout << "Slowest thread per phase:";
+        for (int phase = 0; phase < PHASE_NUM; phase++) {
+            cout << (phase > 0 ? "," : "") << " " << phaseName(static_cast<Phase>(phase)) << " "
+                 << metrics.slowestThreadMilliseconds(static_cast<Phase>(phase)) << " ms";
+        }
+        cout << endl;
+        if (!METRICS_JSON_PATH.empty() && metrics.writeJson(METRICS_JSON_PATH)) {
+            cout << "Iteration metrics saved to " << METRICS_JSON_PATH << endl;
+        }
+        if (!METRICS_CSV_PATH.empty() && metrics.writeCsv(METRICS_CSV_PATH)) {
+            cout << "Iteration metrics saved to " << METRICS_CSV_PATH << endl;
+        }
+    }
+    if (loaderLayoutTime > 0) {
+        cout << "Speedup over the loader layout: " << loaderLayoutTime / run.duration << endl;
+    }
+    if (STOP_ON_CONVERGENCE) {
+        if (run.converged) {
+            cout << "Converged after " << run.iterations << " iterations in " << run.duration << " ms" << endl;
+        } else {
+            cout << "Not converged after " << run.iterations << " iterations" << endl;
         }
     }
-    auto endTime = high_resolution_clock::now();
-    auto time = duration_cast<microseconds>(endTime - startTime).count() / 1000.f;
-    cout << "Duration: " << time << " ms" << endl;
+
+    if (!TRAINED_CENTROIDS_PATH.empty() &&
+        writeCentroids(model.centroids(), TRAINED_CENTROIDS_PATH, TRAINED_CENTROIDS_SECTION)) {
+        cout << "Centroids saved to " << TRAINED_CENTROIDS_PATH << endl;
+    }
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,108 @@
+#include <iostream>
+#include "point_stream.h"
+#include "assignment_kernel.h"
+#include "centroid_config.h"
+#include "kmeans_model.h"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+using namespace std;
+using namespace chrono;
+
+static const string CENTROIDS_PATH = "trained_centroids.ini";
+static const string CENTROIDS_SECTION = TRAINED_CENTROIDS_SECTION;
+// "-" reads the points from the standard input.
+static const string INPUT_PATH = "../datasets/generated_blob_dataset_400k.csv";
+// One label per line; "-" writes them to the standard output.
+static const string LABELS_PATH = "labels.txt";
+static const size_t BATCH_SIZE = 1 << 16;
+static const int THREAD_NUMBER = 16;
+static const bool PRINT_BATCH_LATENCY = false;
+
+bool writeLabels(FILE* output, const vector<int>& labels, size_t count, string& buffer) {
+    buffer.resize(count * 12);
+    char* cursor = buffer.data();
+    for (size_t i = 0; i < count; i++) {
+        cursor = to_chars(cursor, buffer.data() + buffer.size(), labels[i]).ptr;
+        *cursor++ = '\n';
+    }
+    const size_t size = cursor - buffer.data();
+    return fwrite(buffer.data(), 1, size, output) == size;
+}
+
+int main() {
+
+    // Labels may go to the standard output, so the report goes to stderr then.
+    ostream& report = LABELS_PATH == "-" ? cerr : cout;
+
+    DataPoints centroids;
+    if (!readCentroids(centroids, CENTROIDS_PATH, CENTROIDS_SECTION)) return -1;
+    KMeansModel model;
+    model.options().threadNum = THREAD_NUMBER;
+    model.setCentroids(centroids);
+    report << "Loaded " << model.clusterNum() << " centroids of dimension " << model.dimension() << " from "
+           << CENTROIDS_PATH << endl;
+    report << "Nearest-centroid search: "
+           << (CentroidIndex::suits(model.centroids()) ? "kd-tree over the centroids"
+                                                        : selectAssignmentKernel(model.dimension(), model.clusterNum()).name)
+           << endl;
+
+    PointStream stream(INPUT_PATH);
+    if (!stream.isOpen()) return -1;
+    FILE* output = LABELS_PATH == "-" ? stdout : fopen(LABELS_PATH.c_str(), "w");
+    if (!output) {
+        cerr << "Error: Unable to open file " << LABELS_PATH << endl;
+        return -1;
+    }
+
+    DataPoints batch;
+    vector<int> labels(BATCH_SIZE);
+    string buffer;
+    vector<float> latencies;
+    size_t pointNum = 0;
+    bool failed = false;
+    auto startTime = high_resolution_clock::now();
+    while (true) {
+        auto batchStart = high_resolution_clock::now();
+        if (!stream.next(BATCH_SIZE, batch)) break;
+        if (batch.dimension() != model.dimension()) {
+            cerr << "Error: the points have " << batch.dimension() << " coordinates, the model has "
+                 << model.dimension() << endl;
+            failed = true;
+            break;
+        }
+        if (!model.predict(PointsView::fromDataPoints(batch), labels.data()) ||
+            !writeLabels(output, labels, batch.size(), buffer)) {
+            cerr << "Error: Unable to write file " << LABELS_PATH << endl;
+            failed = true;
+            break;
+        }
+        auto batchEnd = high_resolution_clock::now();
+        latencies.push_back(duration_cast<microseconds>(batchEnd - batchStart).count() / 1000.f);
+        if (PRINT_BATCH_LATENCY) {
+            report << "Batch " << latencies.size() << ": " << batch.size() << " points in " << latencies.back() << " ms"
+                   << endl;
+        }
+        pointNum += batch.size();
+    }
+    auto endTime = high_resolution_clock::now();
+    if (output != stdout && fclose(output) != 0) failed = true;
+    if (failed || stream.failed()) return -1;
+
+    auto time = duration_cast<microseconds>(endTime - startTime).count() / 1000.f;
+    report << "Labelled " << pointNum << " points in " << latencies.size() << " batches of up to " << BATCH_SIZE
+           << " points in " << time << " ms";
+    if (time > 0) report << " (" << pointNum / time * 1000 << " points/s)";
+    report << endl;
+    if (!latencies.empty()) {
+        sort(latencies.begin(), latencies.end());
+        report << "Batch latency: median " << latencies[latencies.size() / 2] << " ms, p95 "
+               << latencies[(latencies.size() * 95 + 99) / 100 - 1] << " ms, max " << latencies.back() << " ms"
+               << endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,87 @@
+#include <iostream>
+#include "checkpoint.h"
+#include "centroid_config.h"
+#include "lloyd.h"
+#include <chrono>
+#include <fstream>
+#include <vector>
+
+using namespace std;
+using namespace chrono;
+
+static const string DATASET_PATH = "../datasets/generated_blob_dataset_400k.csv";
+static const string CONFIG_FILE_PATH = "../config_files/config_sets.ini";
+static const string DESIRED_CONFIG = "4_cluster";
+// Saved after every run. When it exists, only the rows appended to the
+// dataset since are read, starting from its centroids.
+static const string CHECKPOINT_PATH = "checkpoint.ini";
+// Cluster of every row of the dataset, one per line, appended at every run.
+static const string LABELS_PATH = "checkpoint_labels.txt";
+// Where the final centroids are saved for k_means_predict, e.g.
+// "trained_centroids.ini"; empty (the default) to skip.
+static const string TRAINED_CENTROIDS_PATH = "";
+// Iterations of the first run, over the whole dataset, and of the later ones
+// over the new rows.
+static const int ITERATION_NUMBER = 10;
+static const int REFRESH_ITERATION_NUMBER = 3;
+static const bool STOP_ON_CONVERGENCE = true;
+static const float CONVERGENCE_TOLERANCE = 1e-4f;
+static const int THREAD_NUMBER = 16;
+
+int main() {
+
+    Checkpoint checkpoint;
+    const bool warmStart = ifstream(CHECKPOINT_PATH).good();
+    if (warmStart && !readCheckpoint(checkpoint, CHECKPOINT_PATH)) return -1;
+
+    auto startTime = high_resolution_clock::now();
+    DataPoints rows;
+    uint64_t dataEnd;
+    if (!readAppendedRows(DATASET_PATH, checkpoint, rows, dataEnd)) return -1;
+    auto endTime = high_resolution_clock::now();
+    const float readTime = duration_cast<microseconds>(endTime - startTime).count() / 1000.f;
+    cout << "Read " << rows.size() << " new rows from " << DATASET_PATH << " in " << readTime << " ms ("
+         << checkpoint.rows << " covered by the checkpoint)" << endl;
+    if (rows.empty()) return 0;
+
+    if (!warmStart) {
+        DataPoints centroids;
+        int clusterNum;
+        if (!initializeCentroids(centroids, clusterNum, CONFIG_FILE_PATH, DESIRED_CONFIG, rows)) return -1;
+        checkpoint = emptyCheckpoint(centroids);
+    } else if (rows.dimension() != checkpoint.centroids.dimension()) {
+        cerr << "Error: the checkpoint has " << checkpoint.centroids.dimension() << " coordinates, the dataset has "
+             << rows.dimension() << endl;
+        return -1;
+    }
+
+    LloydOptions options;
+    options.iterationNum = warmStart ? REFRESH_ITERATION_NUMBER : ITERATION_NUMBER;
+    options.stopOnConvergence = STOP_ON_CONVERGENCE;
+    options.convergenceTolerance = CONVERGENCE_TOLERANCE;
+    options.threadNum = THREAD_NUMBER;
+    options.verbose = false;
+    vector<int> labels;
+    KMeansRun run = kMeansWarmStart(rows, checkpoint, options, labels);
+    checkpoint.dataEnd = dataEnd;
+
+    printCentroids(checkpoint.centroids);
+    cout << (warmStart ? "Warm start: " : "Full run: ") << run.iterations << " iterations over " << rows.size()
+         << " rows in " << run.duration << " ms" << (run.converged ? " (converged)" : "") << endl;
+
+    // Labels first, so that the checkpoint never covers rows without labels.
+    // If the checkpoint cannot be saved, the next run drops the labels
+    // appended after the end the previous checkpoint recorded.
+    if (!saveLabels(labels.data(), labels.size(), LABELS_PATH, checkpoint.labelsEnd) ||
+        !writeCheckpoint(checkpoint, CHECKPOINT_PATH)) {
+        return -1;
+    }
+    cout << "Checkpoint saved to " << CHECKPOINT_PATH << " (" << checkpoint.rows << " rows)" << endl;
+
+    if (!TRAINED_CENTROIDS_PATH.empty() &&
+        writeCentroids(checkpoint.centroids, TRAINED_CENTROIDS_PATH, TRAINED_CENTROIDS_SECTION)) {
+        cout << "Centroids saved to " << TRAINED_CENTROIDS_PATH << endl;
+    }
+
+    return 0;
+}
@@ -1,79 +1,46 @@
 #include <iostream>
-#include "INIReader.h"
-#include <fstream>
-#include <sstream>
-#include <vector>
-#include <chrono>
+#include "dataset_loader.h"
+#include "assignment_kernel.h"
+#include "centroid_config.h"
+#include "kmeans_model.h"
 #include <cmath>
 
 using namespace std;
-using namespace chrono;
 
 static const string DATASET_PATH = "../datasets/generated_blob_dataset_400k.csv";
 static const string CONFIG_FILE_PATH = "../config_files/config_sets.ini";
 static const string DESIRED_CONFIG = "4_cluster";
+// Where the final centroids are saved for k_means_predict, e.g.
+// "trained_centroids.ini"; empty (the default) to skip.
+static const string TRAINED_CENTROIDS_PATH = "";
 static const int ITERATION_NUMBER = 10;
-
-struct DataPoints {
-    std::vector<float> xs;
-    std::vector<float> ys;
-    std::vector<float> zs;
-};
-
-void printCentroids(DataPoints& centroids) {
-    for (int i=0; i<centroids.xs.size(); i++) {
-        cout << "(" << centroids.xs[i] << ", " << centroids.ys[i] << ", " << centroids.zs[i] << ")" << endl;
-    }
-}
-
-bool readDatasetFromFile(DataPoints& dataset, const string& fullPath) {
-    ifstream file(fullPath);
-    if (file.is_open()) {
-        string line;
-        cout << "Reading the dataset..." << endl;
-        while (getline(file, line)) {
-            istringstream coordinates(line);
-            float x;
-            float y;
-            float z;
-            char delimiter1;
-            char delimiter2;
-            if (coordinates >> x >> delimiter1 >> y >> delimiter2 >> z) {
-                dataset.xs.push_back(x);
-                dataset.ys.push_back(y);
-                dataset.zs.push_back(z);
-            }
-        }
-        file.close();
-        cout << "Dataset loaded from " << fullPath << endl;
-        return true;
-    } else {
-        cerr << "Error: Unable to open file " << fullPath << endl;
-        return false;
-    }
-}
-
-bool initializeCentroids(DataPoints& centroids, int& clusterNum, const string& configFilePath, const string& desiredConfig) {
-    INIReader reader(configFilePath);
-    if (reader.ParseError() < 0) {
-        cerr << "Error loading config file\n";
-        return false;
-    }
-    clusterNum = reader.GetInteger(desiredConfig, "cluster_num", 0);
-    for(int i=0; i < clusterNum; i++)  {
-        istringstream coordinates(reader.Get(desiredConfig, "centroid" + to_string(i), ""));
-        float x;
-        float y;
-        float z;
-        char delimiter1;
-        char delimiter2;
-        if (coordinates >> x >> delimiter1 >> y >> delimiter2 >> z){
-            centroids.xs.push_back(x);
-            centroids.ys.push_back(y);
-            centroids.zs.push_back(z);
+static const bool STOP_ON_CONVERGENCE = false;
+static const float CONVERGENCE_TOLERANCE = 1e-4f;
+static const AssignmentEngine ASSIGNMENT_ENGINE = AssignmentEngine::BruteForce;
+// Prints the cluster sizes and centroids after every iteration.
+static const bool VERBOSE = true;
+// Phase times of every iteration and thread (iteration_metrics.h), saved as
+// JSON lines and CSV; empty paths to skip.
+static const string METRICS_JSON_PATH = "";
+static const string METRICS_CSV_PATH = "";
+// Also counts cycles, instructions and cache misses through perf_event_open.
+static const bool HARDWARE_COUNTERS = false;
+// Other than Float32, the run is repeated from the same centroids with the
+// points stored in 16 bits (see compact_points.h) and compared to the first.
+static const PointStorage POINT_STORAGE = PointStorage::Float32;
+
+// Largest distance between matching centroids of two runs.
+float centroidError(const DataPoints& reference, const DataPoints& centroids) {
+    float error = 0;
+    for (size_t i = 0; i < reference.size(); i++) {
+        float squared = 0;
+        for (int d = 0; d < reference.dimension(); d++) {
+            float difference = centroids[d][i] - reference[d][i];
+            squared += difference * difference;
         }
+        error = max(error, sqrt(squared));
     }
-    return true;
+    return error;
 }
 
 int main() {
@@ -82,61 +49,69 @@ int main() {
     if(!readDatasetFromFile(dataPoints, DATASET_PATH)) return -1;
     DataPoints centroids;
     int clusterNum;
-    if (!initializeCentroids(centroids, clusterNum, CONFIG_FILE_PATH, DESIRED_CONFIG)) return -1;
-    vector<int> totalClustersSize(clusterNum);
+    if (!initializeCentroids(centroids, clusterNum, CONFIG_FILE_PATH, DESIRED_CONFIG, dataPoints)) return -1;
 
     printCentroids(centroids);
-
-    auto startTime = high_resolution_clock::now();
-
-    for (int iteration = 0; iteration < ITERATION_NUMBER; iteration++) {
-        cout << endl << "Iteration " << iteration + 1 << ":" << endl;
-
-        DataPoints newCentroids;
-        vector<int> clustersSize(clusterNum);
-        vector<float> defaultCoordinate(clusterNum);
-        newCentroids.xs.insert(newCentroids.xs.end(), defaultCoordinate.begin(), defaultCoordinate.end());
-        newCentroids.ys.insert(newCentroids.ys.end(), defaultCoordinate.begin(), defaultCoordinate.end());
-        newCentroids.zs.insert(newCentroids.zs.end(), defaultCoordinate.begin(), defaultCoordinate.end());
-
-        for (int i = 0; i < dataPoints.xs.size(); i++) {
-            float shortest_distance = sqrt(
-                    pow(centroids.xs[0] - dataPoints.xs[i], 2) + pow(centroids.ys[0] - dataPoints.ys[i], 2) +
-                    pow(centroids.zs[0] - dataPoints.zs[i], 2));
-            int cluster_type = 0;
-            for (int j = 1; j < clusterNum; j++) {
-                float centroid_distance = sqrt(
-                        pow(centroids.xs[j] - dataPoints.xs[i], 2) + pow(centroids.ys[j] - dataPoints.ys[i], 2) +
-                        pow(centroids.zs[j] - dataPoints.zs[i], 2));
-                if (centroid_distance < shortest_distance) {
-                    shortest_distance = centroid_distance;
-                    cluster_type = j;
-                }
-            }
-            newCentroids.xs[cluster_type] += dataPoints.xs[i];
-            newCentroids.ys[cluster_type] += dataPoints.ys[i];
-            newCentroids.zs[cluster_type] += dataPoints.zs[i];
-            clustersSize[cluster_type]++;
-        }
-
-        for (int i = 0; i < clusterNum; i++) {
-            centroids.xs[i] = newCentroids.xs[i] / clustersSize[i];
-            centroids.ys[i] = newCentroids.ys[i] / clustersSize[i];
-            centroids.zs[i] = newCentroids.zs[i] / clustersSize[i];
+    cout << "Assignment kernel: " << selectAssignmentKernel(dataPoints.dimension(), clusterNum).name << endl;
+
+    KMeansModel model(sequentialSoABackend());
+    model.options().iterationNum = ITERATION_NUMBER;
+    model.options().stopOnConvergence = STOP_ON_CONVERGENCE;
+    model.options().convergenceTolerance = CONVERGENCE_TOLERANCE;
+    model.options().engine = ASSIGNMENT_ENGINE;
+    model.options().verbose = VERBOSE;
+    IterationMetrics metrics(HARDWARE_COUNTERS);
+    if (!METRICS_JSON_PATH.empty() || !METRICS_CSV_PATH.empty()) model.options().metrics = &metrics;
+    if (HARDWARE_COUNTERS && !hardwareCountersAvailable()) {
+        cerr << "Warning: hardware counters unavailable, only the phase times are measured" << endl;
+    }
+    KMeansRun run;
+    if (!model.fit(PointsView::fromDataPoints(dataPoints), centroids, run)) return -1;
+
+    cout << "Duration: " << run.duration << " ms" << endl;
+    if (model.options().metrics) {
+        cout << "Slowest thread per phase:";
+        for (int phase = 0; phase < PHASE_NUM; phase++) {
+            cout << (phase > 0 ? "," : "") << " " << phaseName(static_cast<Phase>(phase)) << " "
+                 << metrics.slowestThreadMilliseconds(static_cast<Phase>(phase)) << " ms";
         }
-
         cout << endl;
-        for (int i = 0; i < clusterNum; i++) {
-            cout << "Cluster" << i + 1 << " size: " << clustersSize[i] << endl;
+        if (!METRICS_JSON_PATH.empty() && metrics.writeJson(METRICS_JSON_PATH)) {
+            cout << "Iteration metrics saved to " << METRICS_JSON_PATH << endl;
         }
+        if (!METRICS_CSV_PATH.empty() && metrics.writeCsv(METRICS_CSV_PATH)) {
+            cout << "Iteration metrics saved to " << METRICS_CSV_PATH << endl;
+        }
+    }
+    if (STOP_ON_CONVERGENCE) {
+        if (run.converged) {
+            cout << "Converged after " << run.iterations << " iterations in " << run.duration << " ms" << endl;
+        } else {
+            cout << "Not converged after " << run.iterations << " iterations" << endl;
+        }
+    }
 
-        cout << endl;
-        printCentroids(centroids);
+    if (POINT_STORAGE != PointStorage::Float32) {
+        const CompactPoints compactPoints(dataPoints, POINT_STORAGE);
+        DataPoints compactCentroids = centroids;
+        LloydOptions options = model.options();
+        options.verbose = false;
+        KMeansRun compactRun = kMeansCompact(compactPoints, compactCentroids, options);
+        cout << endl << "Storage\tBytes/point\tDuration (ms)\tPoints/s" << endl;
+        const double pointIterations = static_cast<double>(dataPoints.size()) * run.iterations;
+        cout << storageName(PointStorage::Float32) << "\t" << dataPoints.dimension() * sizeof(float) << "\t"
+             << run.duration << "\t" << pointIterations / run.duration * 1000 << endl;
+        const double compactIterations = static_cast<double>(dataPoints.size()) * compactRun.iterations;
+        cout << storageName(POINT_STORAGE) << "\t" << compactPoints.bytesPerPoint() << "\t" << compactRun.duration
+             << "\t" << compactIterations / compactRun.duration * 1000 << endl;
+        cout << "Max centroid error versus " << storageName(PointStorage::Float32) << ": "
+             << centroidError(model.centroids(), compactCentroids) << endl;
     }
 
-    auto endTime = high_resolution_clock::now();
-    auto time = duration_cast<microseconds>(endTime - startTime).count() / 1000.f;
-    cout << "Duration: " << time << " ms" << endl;
+    if (!TRAINED_CENTROIDS_PATH.empty() &&
+        writeCentroids(model.centroids(), TRAINED_CENTROIDS_PATH, TRAINED_CENTROIDS_SECTION)) {
+        cout << "Centroids saved to " << TRAINED_CENTROIDS_PATH << endl;
+    }
 
     return 0;
 }
@@ -0,0 +1,315 @@
+#include "assignment_kernel.h"
+#include <immintrin.h>
+#include <iterator>
+#include <utility>
+
+using namespace std;
+
+// The vector helpers are only ever inlined into functions compiled for their
+// instruction set, so AVX values never cross a call boundary.
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+namespace {
+
+// Instruction sets: a vector of `lanes` floats, the mask of a comparison and
+// a vector of labels. select() takes `b` where the mask is set.
+struct Scalar {
+    static const int lanes = 1;
+    using Vector = float;
+    using Mask = bool;
+    using Labels = int;
+    static Vector load(const float* values) { return *values; }
+    static void store(float* values, Vector v) { *values = v; }
+    static Vector broadcast(float value) { return value; }
+    static Vector infinity() { return __builtin_inff(); }
+    static Vector add(Vector a, Vector b) { return a + b; }
+    static Vector sub(Vector a, Vector b) { return a - b; }
+    static Vector mul(Vector a, Vector b) { return a * b; }
+    static Vector min(Vector a, Vector b) { return a < b ? a : b; }
+    static Mask less(Vector a, Vector b) { return a < b; }
+    static Vector select(Mask mask, Vector a, Vector b) { return mask ? b : a; }
+    static Labels zeroLabels() { return 0; }
+    static Labels selectLabel(Mask mask, Labels labels, int label) { return mask ? label : labels; }
+    static void storeLabels(int* labels, Labels l) { *labels = l; }
+};
+
+struct Avx2 {
+    static const int lanes = 8;
+    using Vector = __m256;
+    using Mask = __m256;
+    using Labels = __m256i;
+    __attribute__((target("avx2"))) static Vector load(const float* values) { return _mm256_loadu_ps(values); }
+    __attribute__((target("avx2"))) static void store(float* values, Vector v) { _mm256_storeu_ps(values, v); }
+    __attribute__((target("avx2"))) static Vector broadcast(float value) { return _mm256_set1_ps(value); }
+    __attribute__((target("avx2"))) static Vector infinity() { return _mm256_set1_ps(__builtin_inff()); }
+    __attribute__((target("avx2"))) static Vector add(Vector a, Vector b) { return _mm256_add_ps(a, b); }
+    __attribute__((target("avx2"))) static Vector sub(Vector a, Vector b) { return _mm256_sub_ps(a, b); }
+    __attribute__((target("avx2"))) static Vector mul(Vector a, Vector b) { return _mm256_mul_ps(a, b); }
+    __attribute__((target("avx2"))) static Vector min(Vector a, Vector b) { return _mm256_min_ps(a, b); }
+    __attribute__((target("avx2"))) static Mask less(Vector a, Vector b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    __attribute__((target("avx2"))) static Vector select(Mask mask, Vector a, Vector b) {
+        return _mm256_blendv_ps(a, b, mask);
+    }
+    __attribute__((target("avx2"))) static Labels zeroLabels() { return _mm256_setzero_si256(); }
+    __attribute__((target("avx2"))) static Labels selectLabel(Mask mask, Labels labels, int label) {
+        return _mm256_blendv_epi8(labels, _mm256_set1_epi32(label), _mm256_castps_si256(mask));
+    }
+    __attribute__((target("avx2"))) static void storeLabels(int* labels, Labels l) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(labels), l);
+    }
+};
+
+struct Avx512 {
+    static const int lanes = 16;
+    using Vector = __m512;
+    using Mask = __mmask16;
+    using Labels = __m512i;
+    __attribute__((target("avx512f"))) static Vector load(const float* values) { return _mm512_loadu_ps(values); }
+    __attribute__((target("avx512f"))) static void store(float* values, Vector v) { _mm512_storeu_ps(values, v); }
+    __attribute__((target("avx512f"))) static Vector broadcast(float value) { return _mm512_set1_ps(value); }
+    __attribute__((target("avx512f"))) static Vector infinity() { return _mm512_set1_ps(__builtin_inff()); }
+    __attribute__((target("avx512f"))) static Vector add(Vector a, Vector b) { return _mm512_add_ps(a, b); }
+    __attribute__((target("avx512f"))) static Vector sub(Vector a, Vector b) { return _mm512_sub_ps(a, b); }
+    __attribute__((target("avx512f"))) static Vector mul(Vector a, Vector b) { return _mm512_mul_ps(a, b); }
+    __attribute__((target("avx512f"))) static Vector min(Vector a, Vector b) { return _mm512_min_ps(a, b); }
+    __attribute__((target("avx512f"))) static Mask less(Vector a, Vector b) {
+        return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ);
+    }
+    __attribute__((target("avx512f"))) static Vector select(Mask mask, Vector a, Vector b) {
+        return _mm512_mask_blend_ps(mask, a, b);
+    }
+    __attribute__((target("avx512f"))) static Labels zeroLabels() { return _mm512_setzero_si512(); }
+    __attribute__((target("avx512f"))) static Labels selectLabel(Mask mask, Labels labels, int label) {
+        return _mm512_mask_blend_epi32(mask, labels, _mm512_set1_epi32(label));
+    }
+    __attribute__((target("avx512f"))) static void storeLabels(int* labels, Labels l) {
+        _mm512_storeu_si512(labels, l);
+    }
+};
+
+template<typename Body, int... I>
+inline void unrolled(Body& body, integer_sequence<int, I...>) {
+    (body(I), ...);
+}
+
+// Calls body(i) for i in [0, N), fully unrolled, or in [0, count) when N is 0.
+template<int N, typename Body>
+inline void repeat(int count, Body body) {
+    if constexpr (N > 0) {
+        unrolled(body, make_integer_sequence<int, N>());
+    } else {
+        for (int i = 0; i < count; i++) body(i);
+    }
+}
+
+// D and K fix the dimension and the cluster count at compile time; 0 means
+// they are taken from the arguments. Distances are summed in coordinate
+// order in every variant, so all of them round the same way.
+template<typename Isa, int D, int K, bool WithDistances>
+inline void nearestCentroids(const float* const* columns, size_t first, size_t pointNum,
+                             const float* const* centroids, int dimension, int clusterNum, int* labels,
+                             float* shortestDistances, float* secondShortestDistances) {
+    using Vector = typename Isa::Vector;
+    if constexpr (D > 0) dimension = D;
+    if constexpr (K > 0) clusterNum = K;
+    size_t i = 0;
+    for (; i + Isa::lanes <= pointNum; i += Isa::lanes) {
+        // With a known dimension the point stays in registers for the whole scan.
+        Vector point[D > 0 ? D : 1];
+        if constexpr (D > 0) repeat<D>(D, [&](int d) { point[d] = Isa::load(columns[d] + first + i); });
+        auto coordinate = [&](int d) {
+            if constexpr (D > 0) {
+                return point[d];
+            } else {
+                return Isa::load(columns[d] + first + i);
+            }
+        };
+        auto distanceTo = [&](int j) {
+            Vector difference = Isa::sub(Isa::broadcast(centroids[0][j]), coordinate(0));
+            Vector distance = Isa::mul(difference, difference);
+            repeat<(D > 0 ? D - 1 : 0)>(dimension - 1, [&](int d) {
+                Vector difference = Isa::sub(Isa::broadcast(centroids[d + 1][j]), coordinate(d + 1));
+                distance = Isa::add(distance, Isa::mul(difference, difference));
+            });
+            return distance;
+        };
+
+        Vector shortestDistance = distanceTo(0);
+        Vector secondShortestDistance = Isa::infinity();
+        typename Isa::Labels clusterType = Isa::zeroLabels();
+        repeat<(K > 0 ? K - 1 : 0)>(clusterNum - 1, [&](int j) {
+            Vector distance = distanceTo(j + 1);
+            auto closer = Isa::less(distance, shortestDistance);
+            if constexpr (WithDistances) {
+                secondShortestDistance = Isa::select(closer, Isa::min(distance, secondShortestDistance),
+                                                     shortestDistance);
+            }
+            shortestDistance = Isa::select(closer, shortestDistance, distance);
+            clusterType = Isa::selectLabel(closer, clusterType, j + 1);
+        });
+        Isa::storeLabels(labels + i, clusterType);
+        if constexpr (WithDistances) {
+            Isa::store(shortestDistances + i, shortestDistance);
+            Isa::store(secondShortestDistances + i, secondShortestDistance);
+        }
+    }
+    // The remainder goes through the scalar loop over the centroids.
+    if constexpr (Isa::lanes > 1) {
+        if constexpr (WithDistances) {
+            nearestCentroids<Scalar, D, 0, true>(columns, first + i, pointNum - i, centroids, dimension, clusterNum,
+                                                 labels + i, shortestDistances + i, secondShortestDistances + i);
+        } else {
+            nearestCentroids<Scalar, D, 0, false>(columns, first + i, pointNum - i, centroids, dimension, clusterNum,
+                                                  labels + i, nullptr, nullptr);
+        }
+    }
+}
+
+// All coordinates of a point are added before moving to the next one: the
+// additions to different columns overlap, whereas a pass per column would
+// wait on the previous addition to the same sum whenever labels repeat.
+template<int D>
+void accumulatePoints(const float* const* columns, size_t first, size_t pointNum, const int* labels, int dimension,
+                      float* const* sums, int* sizes) {
+    if constexpr (D > 0) dimension = D;
+    for (size_t i = 0; i < pointNum; i++) {
+        const int clusterType = labels[i];
+        repeat<D>(dimension, [&](int d) { sums[d][clusterType] += columns[d][first + i]; });
+        sizes[clusterType]++;
+    }
+}
+
+template<int D>
+void accumulatePointsDouble(const float* const* columns, size_t first, size_t pointNum, const int* labels,
+                            int dimension, double* sums, size_t* sizes) {
+    if constexpr (D > 0) dimension = D;
+    for (size_t i = 0; i < pointNum; i++) {
+        const int clusterType = labels[i];
+        double* sum = sums + static_cast<size_t>(clusterType) * dimension;
+        repeat<D>(dimension, [&](int d) { sum[d] += columns[d][first + i]; });
+        sizes[clusterType]++;
+    }
+}
+
+// Entry points, one pair per instruction set. flatten inlines the helpers
+// above, which are only compiled for the target of the caller.
+template<int D, int K>
+struct ScalarKernel {
+    // Unrolling the centroids buys nothing without vectors to keep busy.
+    static const bool unrollClusters = false;
+    static void assign(const float* const* columns, size_t first, size_t pointNum, const float* const* centroids,
+                       int dimension, int clusterNum, int* labels) {
+        nearestCentroids<Scalar, D, K, false>(columns, first, pointNum, centroids, dimension, clusterNum, labels,
+                                              nullptr, nullptr);
+    }
+    static void assignWithDistances(const float* const* columns, size_t first, size_t pointNum,
+                                    const float* const* centroids, int dimension, int clusterNum, int* labels,
+                                    float* shortestDistances, float* secondShortestDistances) {
+        nearestCentroids<Scalar, D, K, true>(columns, first, pointNum, centroids, dimension, clusterNum, labels,
+                                             shortestDistances, secondShortestDistances);
+    }
+};
+
+template<int D, int K>
+struct Avx2Kernel {
+    static const bool unrollClusters = true;
+    __attribute__((target("avx2"), flatten))
+    static void assign(const float* const* columns, size_t first, size_t pointNum, const float* const* centroids,
+                       int dimension, int clusterNum, int* labels) {
+        nearestCentroids<Avx2, D, K, false>(columns, first, pointNum, centroids, dimension, clusterNum, labels,
+                                            nullptr, nullptr);
+    }
+    __attribute__((target("avx2"), flatten))
+    static void assignWithDistances(const float* const* columns, size_t first, size_t pointNum,
+                                    const float* const* centroids, int dimension, int clusterNum, int* labels,
+                                    float* shortestDistances, float* secondShortestDistances) {
+        nearestCentroids<Avx2, D, K, true>(columns, first, pointNum, centroids, dimension, clusterNum, labels,
+                                           shortestDistances, secondShortestDistances);
+    }
+};
+
+template<int D, int K>
+struct Avx512Kernel {
+    static const bool unrollClusters = true;
+    __attribute__((target("avx512f"), flatten))
+    static void assign(const float* const* columns, size_t first, size_t pointNum, const float* const* centroids,
+                       int dimension, int clusterNum, int* labels) {
+        nearestCentroids<Avx512, D, K, false>(columns, first, pointNum, centroids, dimension, clusterNum, labels,
+                                              nullptr, nullptr);
+    }
+    __attribute__((target("avx512f"), flatten))
+    static void assignWithDistances(const float* const* columns, size_t first, size_t pointNum,
+                                    const float* const* centroids, int dimension, int clusterNum, int* labels,
+                                    float* shortestDistances, float* secondShortestDistances) {
+        nearestCentroids<Avx512, D, K, true>(columns, first, pointNum, centroids, dimension, clusterNum, labels,
+                                             shortestDistances, secondShortestDistances);
+    }
+};
+
+// Runtime shape to template dispatch: the folds below compare the shape with
+// every specialized dimension and cluster count. A specialized size of 0
+// means the kernel loops over the runtime one.
+struct Specialization {
+    decltype(AssignmentKernel::assign) assign;
+    decltype(AssignmentKernel::assignWithDistances) assignWithDistances;
+    decltype(AssignmentKernel::accumulate) accumulate;
+    decltype(AssignmentKernel::accumulateDouble) accumulateDouble;
+    int dimension;
+    int clusterNum;
+};
+
+template<template<int, int> class Kernel, int D, int K>
+Specialization instantiate() {
+    return {Kernel<D, K>::assign, Kernel<D, K>::assignWithDistances, accumulatePoints<D>, accumulatePointsDouble<D>, D, K};
+}
+
+template<template<int, int> class Kernel, int D, int K>
+bool specializeClusters(int clusterNum, Specialization& kernel) {
+    if constexpr (D * K <= MAX_UNROLLED_DISTANCE_TERMS && Kernel<D, K>::unrollClusters) {
+        if (clusterNum != K) return false;
+        kernel = instantiate<Kernel, D, K>();
+        return true;
+    }
+    return false;
+}
+
+template<template<int, int> class Kernel, int D, size_t... I>
+bool specializeDimension(int dimension, int clusterNum, Specialization& kernel, index_sequence<I...>) {
+    if (dimension != D) return false;
+    kernel = instantiate<Kernel, D, 0>();
+    (specializeClusters<Kernel, D, SPECIALIZED_CLUSTER_COUNTS[I]>(clusterNum, kernel) || ...);
+    return true;
+}
+
+template<template<int, int> class Kernel, int... D>
+AssignmentKernel specialize(const char* isa, int dimension, int clusterNum, integer_sequence<int, D...>) {
+    Specialization kernel = instantiate<Kernel, 0, 0>();
+    (specializeDimension<Kernel, D + 2>(dimension, clusterNum, kernel,
+                                        make_index_sequence<size(SPECIALIZED_CLUSTER_COUNTS)>()) || ...);
+    string name = isa;
+    if (kernel.dimension > 0) {
+        name += " (D=" + to_string(kernel.dimension);
+        if (kernel.clusterNum > 0) name += ", K=" + to_string(kernel.clusterNum);
+        name += ")";
+    }
+    return {name, kernel.assign, kernel.assignWithDistances, kernel.accumulate, kernel.accumulateDouble};
+}
+
+template<template<int, int> class Kernel>
+AssignmentKernel specialize(const char* isa, int dimension, int clusterNum) {
+    return specialize<Kernel>(isa, dimension, clusterNum, make_integer_sequence<int, MAX_SPECIALIZED_DIMENSION - 1>());
+}
+
+}
+
+vector<AssignmentKernel> availableAssignmentKernels(int dimension, int clusterNum) {
+    vector<AssignmentKernel> kernels = {specialize<ScalarKernel>("scalar", dimension, clusterNum)};
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) kernels.push_back(specialize<Avx2Kernel>("avx2", dimension, clusterNum));
+    if (__builtin_cpu_supports("avx512f")) kernels.push_back(specialize<Avx512Kernel>("avx512", dimension, clusterNum));
+    return kernels;
+}
+
+AssignmentKernel selectAssignmentKernel(int dimension, int clusterNum) {
+    return availableAssignmentKernels(dimension, clusterNum).back();
+}
@@ -0,0 +1,51 @@
+#ifndef K_MEANS_ASSIGNMENT_KERNEL_H
+#define K_MEANS_ASSIGNMENT_KERNEL_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Points are handed to the kernels in blocks of this size so that the labels
+// of a block stay in L1 while the caller accumulates the new centroids.
+static const std::size_t ASSIGNMENT_BLOCK_SIZE = 1024;
+
+// Nearest-centroid search on squared distances. Ties go to the lowest
+// centroid index, like the original scalar loop. Point i of the call is
+// (columns[0][first + i], columns[1][first + i], ...); centroid j is
+// (centroids[0][j], centroids[1][j], ...).
+struct AssignmentKernel {
+    std::string name;
+    void (*assign)(const float* const* columns, std::size_t first, std::size_t pointNum,
+                   const float* const* centroids, int dimension, int clusterNum, int* labels);
+    // Same search, also returning the squared distances to the nearest and
+    // second-nearest centroid; used by the pruning engines to set bounds.
+    void (*assignWithDistances)(const float* const* columns, std::size_t first, std::size_t pointNum,
+                                const float* const* centroids, int dimension, int clusterNum, int* labels,
+                                float* shortestDistances, float* secondShortestDistances);
+    // Update step for the assigned points: adds point i to sums[d][labels[i]]
+    // for every coordinate d and counts it in sizes[labels[i]]. Points are
+    // added in order, so the sums do not depend on the specialization.
+    void (*accumulate)(const float* const* columns, std::size_t first, std::size_t pointNum, const int* labels,
+                       int dimension, float* const* sums, int* sizes);
+    // Same update step in double, with the sums of cluster j in
+    // sums[j * dimension, (j + 1) * dimension).
+    void (*accumulateDouble)(const float* const* columns, std::size_t first, std::size_t pointNum,
+                             const int* labels, int dimension, double* sums, std::size_t* sizes);
+};
+
+// Kernels are compiled for every dimension in 2..MAX_SPECIALIZED_DIMENSION,
+// and fully unrolled over the centroids for the cluster counts below as long
+// as a point takes at most MAX_UNROLLED_DISTANCE_TERMS coordinate differences.
+// Other shapes loop over the runtime sizes.
+static const int MAX_SPECIALIZED_DIMENSION = 16;
+static constexpr int SPECIALIZED_CLUSTER_COUNTS[] = {2, 4, 8, 16, 32};
+static const int MAX_UNROLLED_DISTANCE_TERMS = 128;
+
+// Widest kernel supported by the running CPU (AVX-512, AVX2, then scalar),
+// specialized for the given shape when possible.
+AssignmentKernel selectAssignmentKernel(int dimension, int clusterNum);
+
+// Every kernel the running CPU can execute for the given shape, scalar first.
+std::vector<AssignmentKernel> availableAssignmentKernels(int dimension, int clusterNum);
+
+#endif //K_MEANS_ASSIGNMENT_KERNEL_H
@@ -0,0 +1,94 @@
+#include "binary_dataset.h"
+#include <climits>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sys/mman.h>
+
+using namespace std;
+
+namespace {
+
+uint64_t alignUp(uint64_t value) {
+    return (value + BINARY_DATASET_ALIGNMENT - 1) / BINARY_DATASET_ALIGNMENT * BINARY_DATASET_ALIGNMENT;
+}
+
+// Whether the columns described by `header` lie inside a file of `fileSize`
+// bytes. Every bound is checked before it is multiplied, so that a corrupt
+// header cannot wrap the products around.
+bool fitsInFile(const BinaryDatasetHeader& header, uint64_t fileSize) {
+    if (header.dimension == 0 || header.dimension > INT_MAX || header.dataOffset < sizeof(header) ||
+        header.dataOffset > fileSize) {
+        return false;
+    }
+    const uint64_t available = fileSize - header.dataOffset;
+    if (header.rows > available / sizeof(float)) return false;
+    const uint64_t columnBytes = header.rows * sizeof(float);
+    if (header.columnStride < columnBytes) return false;
+    if (header.dimension == 1 || header.columnStride == 0) return true;
+    return header.dimension - 1 <= (available - columnBytes) / header.columnStride;
+}
+
+void mapColumn(FloatColumn& column, float* values, uint64_t rows, const shared_ptr<MappedFile>& file) {
+    if (column.empty()) {
+        column.adopt(values, rows, file);
+    } else {
+        column.insert(column.end(), values, values + rows);
+    }
+}
+
+}
+
+bool isBinaryDataset(const MappedFile& file) {
+    return file.size() >= sizeof(BinaryDatasetHeader) &&
+           memcmp(file.data(), BINARY_DATASET_MAGIC, sizeof(BINARY_DATASET_MAGIC)) == 0;
+}
+
+bool mapBinaryDataset(DataPoints& dataset, const shared_ptr<MappedFile>& file, const string& fullPath) {
+    BinaryDatasetHeader header{};
+    memcpy(&header, file->data(), sizeof(header));
+    if (header.dataOffset % BINARY_DATASET_ALIGNMENT != 0 || header.columnStride % BINARY_DATASET_ALIGNMENT != 0 ||
+        !fitsInFile(header, file->size())) {
+        cerr << "Error: Malformed binary dataset " << fullPath << endl;
+        return false;
+    }
+    if (dataset.dimension() == 0) dataset = DataPoints(static_cast<int>(header.dimension));
+    if (static_cast<uint32_t>(dataset.dimension()) != header.dimension) {
+        cerr << "Error: " << fullPath << " has dimension " << header.dimension << ", expected "
+             << dataset.dimension() << endl;
+        return false;
+    }
+    file->advise(MADV_WILLNEED);
+    auto columns = reinterpret_cast<float*>(file->data() + header.dataOffset);
+    const uint64_t stride = header.columnStride / sizeof(float);
+    for (int d = 0; d < dataset.dimension(); d++) {
+        mapColumn(dataset[d], columns + d * stride, header.rows, file);
+    }
+    return true;
+}
+
+bool writeBinaryDataset(const DataPoints& dataset, const string& fullPath) {
+    ofstream file(fullPath, ios::binary | ios::trunc);
+    if (!file.is_open()) {
+        cerr << "Error: Unable to open file " << fullPath << endl;
+        return false;
+    }
+    BinaryDatasetHeader header{};
+    memcpy(header.magic, BINARY_DATASET_MAGIC, sizeof(BINARY_DATASET_MAGIC));
+    header.rows = dataset.size();
+    header.dimension = static_cast<uint32_t>(dataset.dimension());
+    header.dataOffset = alignUp(sizeof(header));
+    header.columnStride = alignUp(header.rows * sizeof(float));
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    const vector<char> padding(header.columnStride - header.rows * sizeof(float), 0);
+    for (const FloatColumn& column : dataset.columns) {
+        file.write(reinterpret_cast<const char*>(column.data()), static_cast<streamsize>(header.rows * sizeof(float)));
+        file.write(padding.data(), static_cast<streamsize>(padding.size()));
+    }
+    if (!file) {
+        cerr << "Error: Unable to write file " << fullPath << endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,36 @@
+#ifndef K_MEANS_BINARY_DATASET_H
+#define K_MEANS_BINARY_DATASET_H
+
+#include "data_points.h"
+#include "mapped_file.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Binary columnar dataset: a 64-byte header followed by one float32 column
+// per coordinate. Every column starts on a 64-byte boundary, so a mapped
+// file can be used directly as the SoA arrays.
+static const char BINARY_DATASET_MAGIC[8] = {'K', 'M', 'E', 'A', 'N', 'S', 'B', '1'};
+static const std::uint64_t BINARY_DATASET_ALIGNMENT = 64;
+
+struct BinaryDatasetHeader {
+    char magic[8];
+    std::uint64_t rows;
+    std::uint32_t dimension;
+    std::uint32_t reserved;
+    std::uint64_t dataOffset;
+    std::uint64_t columnStride;
+    std::uint8_t padding[24];
+};
+
+static_assert(sizeof(BinaryDatasetHeader) == BINARY_DATASET_ALIGNMENT, "header must fill one alignment unit");
+
+bool isBinaryDataset(const MappedFile& file);
+
+// Points the columns of an empty `dataset` straight into the mapping (no
+// copy); rows are appended by copy when the dataset already holds points.
+bool mapBinaryDataset(DataPoints& dataset, const std::shared_ptr<MappedFile>& file, const std::string& fullPath);
+
+bool writeBinaryDataset(const DataPoints& dataset, const std::string& fullPath);
+
+#endif //K_MEANS_BINARY_DATASET_H
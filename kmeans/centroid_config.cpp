@@ -0,0 +1,103 @@
+#include "centroid_config.h"
+#include "seeding.h"
+#include <chrono>
+#include <fstream>
+#include <limits>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+using namespace std;
+using namespace chrono;
+
+bool readConfigCentroids(const INIReader& reader, const string& section, int clusterNum, int dimension,
+                         DataPoints& centroids) {
+    centroids = DataPoints(dimension);
+    for(int i=0; i < clusterNum; i++)  {
+        istringstream coordinates(reader.Get(section, "centroid" + to_string(i), ""));
+        vector<float> centroid;
+        float coordinate;
+        char delimiter;
+        if (coordinates >> coordinate) {
+            centroid.push_back(coordinate);
+            while (coordinates >> delimiter >> coordinate) centroid.push_back(coordinate);
+        }
+        if (centroid.empty()) continue;
+        if (centroids.dimension() == 0) {
+            dimension = static_cast<int>(centroid.size());
+            centroids = DataPoints(dimension);
+        }
+        if (centroid.size() != static_cast<size_t>(dimension)) {
+            cerr << "Error: centroid" << i << " has " << centroid.size() << " coordinates, the dataset has "
+                 << dimension << endl;
+            return false;
+        }
+        centroids.pushPoint(centroid.data());
+    }
+    return true;
+}
+
+bool initializeCentroids(DataPoints& centroids, int& clusterNum, const string& configFilePath, const string& desiredConfig,
+                         const DataPoints& dataPoints) {
+    INIReader reader(configFilePath);
+    if (reader.ParseError() < 0) {
+        cerr << "Error loading config file\n";
+        return false;
+    }
+    clusterNum = reader.GetInteger(desiredConfig, "cluster_num", 0);
+    SeedingOptions seeding;
+    if (!readSeedingOptions(reader, desiredConfig, clusterNum, seeding)) return false;
+    if (seeding.method != SeedingMethod::Config) {
+        auto startTime = high_resolution_clock::now();
+        if (!seedCentroids(dataPoints, seeding, centroids)) return false;
+        auto endTime = high_resolution_clock::now();
+        auto time = duration_cast<microseconds>(endTime - startTime).count() / 1000.f;
+        cout << "Seeding (" << seedingMethodName(seeding.method) << "): " << time << " ms" << endl;
+        return true;
+    }
+    return readConfigCentroids(reader, desiredConfig, clusterNum, dataPoints.dimension(), centroids);
+}
+
+void printCentroids(const DataPoints& centroids) {
+    for (size_t i = 0; i < centroids.size(); i++) {
+        cout << "(";
+        for (int d = 0; d < centroids.dimension(); d++) cout << (d > 0 ? ", " : "") << centroids[d][i];
+        cout << ")" << endl;
+    }
+}
+
+bool writeCentroids(const DataPoints& centroids, const string& fullPath, const string& section) {
+    ofstream file(fullPath, ios::trunc);
+    if (!file.is_open()) {
+        cerr << "Error: Unable to open file " << fullPath << endl;
+        return false;
+    }
+    file.precision(numeric_limits<float>::max_digits10);
+    file << "[" << section << "]" << endl;
+    file << "cluster_num=" << centroids.size() << endl;
+    for (size_t i = 0; i < centroids.size(); i++) {
+        file << "centroid" << i << "=";
+        for (int d = 0; d < centroids.dimension(); d++) file << (d > 0 ? "," : "") << centroids[d][i];
+        file << endl;
+    }
+    if (!file) {
+        cerr << "Error: Unable to write file " << fullPath << endl;
+        return false;
+    }
+    return true;
+}
+
+bool readCentroids(DataPoints& centroids, const string& fullPath, const string& section) {
+    INIReader reader(fullPath);
+    if (reader.ParseError() < 0) {
+        cerr << "Error: Unable to open file " << fullPath << endl;
+        return false;
+    }
+    const int clusterNum = reader.GetInteger(section, "cluster_num", 0);
+    if (!readConfigCentroids(reader, section, clusterNum, 0, centroids)) return false;
+    if (centroids.empty()) {
+        cerr << "Error: No centroids in section " << section << " of " << fullPath << endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,29 @@
+#ifndef K_MEANS_CENTROID_CONFIG_H
+#define K_MEANS_CENTROID_CONFIG_H
+
+#include "INIReader.h"
+#include "data_points.h"
+#include <string>
+
+// Reads the "centroidN" entries of `section`, each a comma-separated list of
+// `dimension` coordinates. Missing entries are skipped. A dimension of 0 is
+// taken from the first entry.
+bool readConfigCentroids(const INIReader& reader, const std::string& section, int clusterNum, int dimension,
+                         DataPoints& centroids);
+
+// Reads "cluster_num" and the initial centroids of `desiredConfig`, either
+// from the config itself or seeded from `dataPoints` (see seeding.h).
+bool initializeCentroids(DataPoints& centroids, int& clusterNum, const std::string& configFilePath,
+                         const std::string& desiredConfig, const DataPoints& dataPoints);
+
+void printCentroids(const DataPoints& centroids);
+
+static const std::string TRAINED_CENTROIDS_SECTION = "trained";
+
+// Centroids files are INI files holding one section in the config format
+// ("cluster_num" and "centroidN"), written with enough digits to read back
+// the same floats.
+bool writeCentroids(const DataPoints& centroids, const std::string& fullPath, const std::string& section);
+bool readCentroids(DataPoints& centroids, const std::string& fullPath, const std::string& section);
+
+#endif //K_MEANS_CENTROID_CONFIG_H
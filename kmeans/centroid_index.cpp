@@ -0,0 +1,140 @@
+#include "centroid_index.h"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <utility>
+
+using namespace std;
+
+// Centroids scanned linearly at the bottom of the tree.
+static const int LEAF_SIZE = 16;
+// Deeper than any tree built over an int number of centroids.
+static const int MAX_DEPTH = 64;
+
+CentroidIndex::CentroidIndex(const DataPoints& centroids)
+        : dimension(centroids.dimension()), coordinates(centroids.dimension()), clusters(centroids.size()) {
+    iota(clusters.begin(), clusters.end(), 0);
+    for (int d = 0; d < dimension; d++) coordinates[d].assign(centroids[d].begin(), centroids[d].end());
+    if (!clusters.empty()) build(0, static_cast<int>(clusters.size()));
+    // Slots were permuted while building; lay the coordinates out in slot order.
+    for (int d = 0; d < dimension; d++) {
+        for (size_t slot = 0; slot < clusters.size(); slot++) coordinates[d][slot] = centroids[d][clusters[slot]];
+    }
+}
+
+bool CentroidIndex::suits(const DataPoints& centroids) {
+    if (static_cast<int>(centroids.size()) < CENTROID_INDEX_MIN_CLUSTERS ||
+        centroids.dimension() > CENTROID_INDEX_MAX_DIMENSION) {
+        return false;
+    }
+    for (const auto& column : centroids.columns) {
+        for (float value : column) {
+            if (!isfinite(value)) return false;
+        }
+    }
+    return true;
+}
+
+int CentroidIndex::build(int begin, int end) {
+    const int node = static_cast<int>(nodes.size());
+    nodes.push_back({-1, -1, 0, 0, begin, end});
+    if (end - begin <= LEAF_SIZE) return node;
+
+    // Split the widest coordinate at the median centroid.
+    int splitDimension = 0;
+    float widestSpread = -1;
+    for (int d = 0; d < dimension; d++) {
+        auto range = minmax_element(clusters.begin() + begin, clusters.begin() + end, [&](int a, int b) {
+            return coordinates[d][a] < coordinates[d][b];
+        });
+        float spread = coordinates[d][*range.second] - coordinates[d][*range.first];
+        if (spread > widestSpread) {
+            widestSpread = spread;
+            splitDimension = d;
+        }
+    }
+    const int middle = begin + (end - begin) / 2;
+    const vector<float>& values = coordinates[splitDimension];
+    nth_element(clusters.begin() + begin, clusters.begin() + middle, clusters.begin() + end,
+                [&](int a, int b) { return values[a] < values[b]; });
+    const float split = values[clusters[middle]];
+
+    const int left = build(begin, middle);
+    const int right = build(middle, end);
+    nodes[node] = {left, right, splitDimension, split, begin, end};
+    return node;
+}
+
+namespace {
+
+// Relative margin applied to the subtree bounds, well above the rounding
+// error of the float distances (see hamerly_engine.cpp).
+const float BOUND_TOLERANCE = 1e-5f;
+
+}
+
+template<int D>
+void CentroidIndex::search(const float* const* columns, size_t first, size_t pointNum, int* labels) const {
+    struct Pending {
+        int node;
+        float bound;
+        float offsets[D];
+    };
+    Pending stack[MAX_DEPTH];
+    for (size_t i = 0; i < pointNum; i++) {
+        float point[D];
+        for (int d = 0; d < D; d++) point[d] = columns[d][first + i];
+        float shortestDistance = INFINITY;
+        int clusterType = 0;
+        int depth = 0;
+        stack[depth].node = 0;
+        stack[depth].bound = 0;
+        for (int d = 0; d < D; d++) stack[depth].offsets[d] = 0;
+        depth++;
+        while (depth > 0) {
+            Pending pending = stack[--depth];
+            // The bound is the squared distance to the subtree's box along the
+            // split coordinates seen so far. Equal distances are still
+            // explored, the subtree may hold a lower index.
+            if (pending.bound * (1 - BOUND_TOLERANCE) > shortestDistance) continue;
+            const Node* node = &nodes[pending.node];
+            while (node->left >= 0) {
+                const int d = node->splitDimension;
+                float difference = node->split - point[d];
+                int nearChild = difference > 0 ? node->left : node->right;
+                int farChild = difference > 0 ? node->right : node->left;
+                Pending& far = stack[depth++];
+                far.node = farChild;
+                far.bound = pending.bound - pending.offsets[d] * pending.offsets[d] + difference * difference;
+                for (int k = 0; k < D; k++) far.offsets[k] = pending.offsets[k];
+                far.offsets[d] = difference;
+                if (far.bound * (1 - BOUND_TOLERANCE) > shortestDistance) depth--;
+                node = &nodes[nearChild];
+            }
+            for (int slot = node->begin; slot < node->end; slot++) {
+                // Summed in coordinate order, like the assignment kernels.
+                float difference = coordinates[0][slot] - point[0];
+                float distance = difference * difference;
+                for (int d = 1; d < D; d++) {
+                    difference = coordinates[d][slot] - point[d];
+                    distance += difference * difference;
+                }
+                if (distance < shortestDistance || (distance == shortestDistance && clusters[slot] < clusterType)) {
+                    shortestDistance = distance;
+                    clusterType = clusters[slot];
+                }
+            }
+        }
+        labels[i] = clusterType;
+    }
+}
+
+template<int... D>
+void CentroidIndex::dispatch(const float* const* columns, size_t first, size_t pointNum, int* labels,
+                             integer_sequence<int, D...>) const {
+    ((dimension == D + 1 && (search<D + 1>(columns, first, pointNum, labels), true)) || ...);
+}
+
+void CentroidIndex::assign(const float* const* columns, size_t first, size_t pointNum, int* labels) const {
+    dispatch(columns, first, pointNum, labels, make_integer_sequence<int, CENTROID_INDEX_MAX_DIMENSION>());
+}
@@ -0,0 +1,58 @@
+#ifndef K_MEANS_CENTROID_INDEX_H
+#define K_MEANS_CENTROID_INDEX_H
+
+#include "data_points.h"
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Below this many centroids, or above CENTROID_INDEX_MAX_DIMENSION
+// coordinates, the vectorized linear scan is faster than the index (with
+// AVX-512 on uniformly spread 3-D centroids the two meet around K = 1500).
+static const int CENTROID_INDEX_MIN_CLUSTERS = 2048;
+static const int CENTROID_INDEX_MAX_DIMENSION = 4;
+
+// Kd-tree over the centroids for nearest-centroid queries with many
+// clusters. Distances are computed like the assignment kernels and ties go
+// to the lowest centroid index, so labels match the linear scan exactly.
+class CentroidIndex {
+public:
+    CentroidIndex() = default;
+    explicit CentroidIndex(const DataPoints& centroids);
+
+    // True when the centroids are worth indexing: enough of them, low
+    // dimension, and all finite (a NaN centroid makes the scan order matter).
+    static bool suits(const DataPoints& centroids);
+
+    bool empty() const { return nodes.empty(); }
+
+    // Same contract as AssignmentKernel::assign.
+    void assign(const float* const* columns, std::size_t first, std::size_t pointNum, int* labels) const;
+
+private:
+    struct Node {
+        // Children of an inner node; a leaf has left == -1 and holds the
+        // centroid slots [begin, end).
+        int left;
+        int right;
+        int splitDimension;
+        float split;
+        int begin;
+        int end;
+    };
+
+    int build(int begin, int end);
+    template<int D>
+    void search(const float* const* columns, std::size_t first, std::size_t pointNum, int* labels) const;
+    template<int... D>
+    void dispatch(const float* const* columns, std::size_t first, std::size_t pointNum, int* labels,
+                  std::integer_sequence<int, D...>) const;
+
+    int dimension = 0;
+    std::vector<Node> nodes;
+    // Centroids in leaf order, one array per coordinate, and their indices.
+    std::vector<std::vector<float>> coordinates;
+    std::vector<int> clusters;
+};
+
+#endif //K_MEANS_CENTROID_INDEX_H
@@ -0,0 +1,172 @@
+#include "checkpoint.h"
+#include "binary_dataset.h"
+#include "centroid_config.h"
+#include "dataset_loader.h"
+#include "INIReader.h"
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <sstream>
+
+using namespace std;
+
+Checkpoint emptyCheckpoint(const DataPoints& centroids) {
+    Checkpoint checkpoint;
+    checkpoint.centroids = centroids;
+    checkpoint.sums.assign(centroids.size() * centroids.dimension(), 0);
+    checkpoint.counts.assign(centroids.size(), 0);
+    return checkpoint;
+}
+
+bool writeCheckpoint(const Checkpoint& checkpoint, const string& fullPath) {
+    const string temporaryPath = fullPath + ".tmp";
+    ofstream file(temporaryPath, ios::trunc);
+    if (!file.is_open()) {
+        cerr << "Error: Unable to open file " << temporaryPath << endl;
+        return false;
+    }
+    const DataPoints& centroids = checkpoint.centroids;
+    const int dimension = centroids.dimension();
+    file << "[" << CHECKPOINT_SECTION << "]" << endl;
+    file << "cluster_num=" << centroids.size() << endl;
+    file.precision(numeric_limits<float>::max_digits10);
+    for (size_t i = 0; i < centroids.size(); i++) {
+        file << "centroid" << i << "=";
+        for (int d = 0; d < dimension; d++) file << (d > 0 ? "," : "") << centroids[d][i];
+        file << endl;
+    }
+    file.precision(numeric_limits<double>::max_digits10);
+    for (size_t i = 0; i < centroids.size(); i++) {
+        file << "sum" << i << "=";
+        for (int d = 0; d < dimension; d++) file << (d > 0 ? "," : "") << checkpoint.sums[i * dimension + d];
+        file << endl;
+        file << "count" << i << "=" << checkpoint.counts[i] << endl;
+    }
+    file << "rows=" << checkpoint.rows << endl;
+    file << "data_end=" << checkpoint.dataEnd << endl;
+    file << "labels_end=" << checkpoint.labelsEnd << endl;
+    file.close();
+    if (!file) {
+        cerr << "Error: Unable to write file " << temporaryPath << endl;
+        remove(temporaryPath.c_str());
+        return false;
+    }
+    if (rename(temporaryPath.c_str(), fullPath.c_str()) != 0) {
+        cerr << "Error: Unable to replace file " << fullPath << endl;
+        remove(temporaryPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool readCheckpoint(Checkpoint& checkpoint, const string& fullPath) {
+    INIReader reader(fullPath);
+    if (reader.ParseError() < 0) {
+        cerr << "Error: Unable to open file " << fullPath << endl;
+        return false;
+    }
+    const int clusterNum = reader.GetInteger(CHECKPOINT_SECTION, "cluster_num", 0);
+    Checkpoint loaded;
+    if (!readConfigCentroids(reader, CHECKPOINT_SECTION, clusterNum, 0, loaded.centroids)) return false;
+    if (loaded.centroids.size() != static_cast<size_t>(clusterNum) || clusterNum == 0) {
+        cerr << "Error: " << fullPath << " does not hold " << clusterNum << " centroids" << endl;
+        return false;
+    }
+    const int dimension = loaded.centroids.dimension();
+    for (int i = 0; i < clusterNum; i++) {
+        istringstream sums(reader.Get(CHECKPOINT_SECTION, "sum" + to_string(i), ""));
+        double sum;
+        char delimiter;
+        for (int d = 0; d < dimension; d++) {
+            if (!(d == 0 || sums >> delimiter) || !(sums >> sum)) {
+                cerr << "Error: sum" << i << " of " << fullPath << " needs " << dimension << " values" << endl;
+                return false;
+            }
+            loaded.sums.push_back(sum);
+        }
+        loaded.counts.push_back(reader.GetUnsigned64(CHECKPOINT_SECTION, "count" + to_string(i), 0));
+    }
+    loaded.rows = reader.GetUnsigned64(CHECKPOINT_SECTION, "rows", 0);
+    loaded.dataEnd = reader.GetUnsigned64(CHECKPOINT_SECTION, "data_end", 0);
+    // Checkpoints saved before labels_end existed keep their whole labels file.
+    loaded.labelsEnd = reader.GetUnsigned64(CHECKPOINT_SECTION, "labels_end", UINT64_MAX);
+    checkpoint = move(loaded);
+    return true;
+}
+
+bool readAppendedRows(const string& fullPath, const Checkpoint& checkpoint, DataPoints& rows, uint64_t& dataEnd) {
+    auto file = make_shared<MappedFile>(fullPath);
+    if (!file->isOpen()) {
+        cerr << "Error: Unable to open file " << fullPath << endl;
+        return false;
+    }
+    rows = DataPoints(checkpoint.centroids.dimension());
+    if (isBinaryDataset(*file)) {
+        // Only the pages of the new rows are read from the mapping.
+        DataPoints dataset;
+        if (!mapBinaryDataset(dataset, file, fullPath)) return false;
+        if (dataset.size() < checkpoint.dataEnd) {
+            cerr << "Error: " << fullPath << " has fewer rows than the checkpoint" << endl;
+            return false;
+        }
+        const size_t first = checkpoint.dataEnd;
+        rows = DataPoints(dataset.dimension());
+        rows.resize(dataset.size() - first);
+        for (int d = 0; d < dataset.dimension(); d++) {
+            memcpy(rows[d].data(), dataset[d].data() + first, rows.size() * sizeof(float));
+        }
+        dataEnd = dataset.size();
+        return true;
+    }
+    if (file->size() < checkpoint.dataEnd) {
+        cerr << "Error: " << fullPath << " is shorter than the checkpoint" << endl;
+        return false;
+    }
+    const char* tail = file->data() + checkpoint.dataEnd;
+    size_t size = file->size() - checkpoint.dataEnd;
+    while (size > 0 && tail[size - 1] != '\n') size--;
+    dataEnd = checkpoint.dataEnd + size;
+    size_t loadedRows = 0;
+    if (size > 0 && !parseCsvText(tail, size, rows, loadedRows) && checkpoint.dataEnd == 0) {
+        cerr << "Error: No coordinates found in " << fullPath << endl;
+        return false;
+    }
+    return true;
+}
+
+bool saveLabels(const int* labels, size_t count, const string& fullPath, uint64_t& labelsEnd) {
+    error_code error;
+    if (labelsEnd > 0 && labelsEnd != UINT64_MAX) {
+        const uint64_t size = filesystem::file_size(fullPath, error);
+        if (error || size < labelsEnd) {
+            cerr << "Error: " << fullPath << " is shorter than the checkpoint" << endl;
+            return false;
+        }
+        if (size > labelsEnd) filesystem::resize_file(fullPath, labelsEnd, error);
+        if (error) {
+            cerr << "Error: Unable to truncate file " << fullPath << endl;
+            return false;
+        }
+    }
+    ofstream file(fullPath, labelsEnd > 0 ? ios::app : ios::trunc);
+    if (!file.is_open()) {
+        cerr << "Error: Unable to open file " << fullPath << endl;
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) file << labels[i] << '\n';
+    file.close();
+    if (!file) {
+        cerr << "Error: Unable to write file " << fullPath << endl;
+        return false;
+    }
+    labelsEnd = filesystem::file_size(fullPath, error);
+    if (error) {
+        cerr << "Error: Unable to read the size of " << fullPath << endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,51 @@
+#ifndef K_MEANS_CHECKPOINT_H
+#define K_MEANS_CHECKPOINT_H
+
+#include "data_points.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// State of a trained model from which a later run goes on with only the rows
+// appended to the dataset since (kMeansWarmStart in lloyd.h). Saved as an INI
+// section in the centroids format (centroid_config.h) plus "sumN", "countN",
+// "rows", "data_end" and "labels_end".
+struct Checkpoint {
+    DataPoints centroids;
+    // Coordinate sums and number of the points of every cluster, over all the
+    // rows covered; the sums are stored cluster after cluster.
+    std::vector<double> sums;
+    std::vector<std::uint64_t> counts;
+    // Rows covered, and where they end in the dataset: a byte offset in a CSV
+    // file, a row in a binary one.
+    std::uint64_t rows = 0;
+    std::uint64_t dataEnd = 0;
+    // Bytes of the labels file holding the labels of those rows (saveLabels).
+    std::uint64_t labelsEnd = 0;
+};
+
+static const std::string CHECKPOINT_SECTION = "checkpoint";
+
+// A checkpoint covering no rows yet, to start from `centroids`.
+Checkpoint emptyCheckpoint(const DataPoints& centroids);
+
+// Writes a temporary file next to `fullPath` and renames it, so that a failed
+// write leaves the previous checkpoint in place.
+bool writeCheckpoint(const Checkpoint& checkpoint, const std::string& fullPath);
+bool readCheckpoint(Checkpoint& checkpoint, const std::string& fullPath);
+
+// Reads the rows of the dataset that come after checkpoint.dataEnd into
+// `rows`, without parsing or copying the ones before, and sets `dataEnd` to
+// their end. A CSV line without its newline yet (still being written) is left
+// for the next call.
+bool readAppendedRows(const std::string& fullPath, const Checkpoint& checkpoint, DataPoints& rows,
+                      std::uint64_t& dataEnd);
+
+// Appends one label per line to the first `labelsEnd` bytes of the file
+// (none when 0), dropping anything written after them, and sets `labelsEnd`
+// to the new end. Labels appended by a run whose checkpoint was never saved
+// are thus replaced by the next run.
+bool saveLabels(const int* labels, std::size_t count, const std::string& fullPath, std::uint64_t& labelsEnd);
+
+#endif //K_MEANS_CHECKPOINT_H
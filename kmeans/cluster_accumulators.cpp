@@ -0,0 +1,45 @@
+#include "cluster_accumulators.h"
+#include <algorithm>
+#include <new>
+
+using namespace std;
+
+namespace {
+
+const size_t CACHE_LINE_SIZE = 64;
+
+template<typename T>
+T* allocateCacheAligned(size_t count) {
+    size_t bytes = (count * sizeof(T) + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+    void* memory = aligned_alloc(CACHE_LINE_SIZE, max(bytes, CACHE_LINE_SIZE));
+    if (memory == nullptr) throw bad_alloc();
+    return static_cast<T*>(memory);
+}
+
+}
+
+ClusterAccumulators::ClusterAccumulators(int threadNum, int dimension, int clusterNum)
+        : threadNum(threadNum),
+          dimension(dimension),
+          clusterStride((clusterNum * sizeof(float) + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE /
+                        sizeof(float)),
+          values(allocateCacheAligned<float>(threadNum * dimension * clusterStride)),
+          counts(allocateCacheAligned<int>(threadNum * clusterStride)) {
+    fill(values.get(), values.get() + threadNum * dimension * clusterStride, 0.0f);
+    fill(counts.get(), counts.get() + threadNum * clusterStride, 0);
+}
+
+void ClusterAccumulators::clear(int thread) {
+    fill(sums(thread, 0), sums(thread, 0) + dimension * clusterStride, 0.0f);
+    fill(sizes(thread), sizes(thread) + clusterStride, 0);
+}
+
+void ClusterAccumulators::merge(int cluster, float* sum, int& size) const {
+    fill(sum, sum + dimension, 0.0f);
+    size = 0;
+    for (int thread = 0; thread < threadNum; thread++) {
+        const float* slice = values.get() + thread * dimension * clusterStride;
+        for (int d = 0; d < dimension; d++) sum[d] += slice[d * clusterStride + cluster];
+        size += counts[thread * clusterStride + cluster];
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef K_MEANS_CLUSTER_ACCUMULATORS_H
+#define K_MEANS_CLUSTER_ACCUMULATORS_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <memory>
+
+// Per-thread partial sums and sizes of every cluster, allocated once and
+// reused across iterations. Each thread's slice starts on its own cache line,
+// so threads never write to a line owned by another thread.
+class ClusterAccumulators {
+public:
+    ClusterAccumulators(int threadNum, int dimension, int clusterNum);
+
+    int threads() const { return threadNum; }
+    // Sums of coordinate `d` of every cluster.
+    float* sums(int thread, int d) { return values.get() + (thread * dimension + d) * clusterStride; }
+    int* sizes(int thread) { return counts.get() + thread * clusterStride; }
+
+    // Zeroes the slice of `thread`; called by the owning thread so that its
+    // pages are first touched where they are used.
+    void clear(int thread);
+
+    // Slices of every thread one after the other, e.g. to exchange them
+    // between processes: the sums take sumsPerThread() floats per thread.
+    float* allSums() { return values.get(); }
+    int* allSizes() { return counts.get(); }
+    std::size_t sumsPerThread() const { return dimension * clusterStride; }
+    std::size_t sizesPerThread() const { return clusterStride; }
+
+    // Adds up slot `cluster` of every thread, in thread order; `sum` receives
+    // one value per coordinate.
+    void merge(int cluster, float* sum, int& size) const;
+
+private:
+    struct Deleter {
+        void operator()(void* memory) const { std::free(memory); }
+    };
+
+    int threadNum;
+    int dimension;
+    std::size_t clusterStride;
+    std::unique_ptr<float[], Deleter> values;
+    std::unique_ptr<int[], Deleter> counts;
+};
+
+#endif //K_MEANS_CLUSTER_ACCUMULATORS_H
@@ -0,0 +1,158 @@
+#include "compact_points.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <immintrin.h>
+
+using namespace std;
+
+namespace {
+
+// Int16 codes use [-INT16_LIMIT, INT16_LIMIT], symmetric around the offset.
+const int INT16_LIMIT = 32767;
+
+inline uint32_t floatBits(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+inline float bitsFloat(uint32_t bits) {
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Rounds to nearest, ties to even, like the hardware conversions.
+uint16_t toHalf(float value) {
+    const uint16_t sign = static_cast<uint16_t>((floatBits(value) >> 16) & 0x8000);
+    const float magnitude = fabs(value);
+    if (isnan(value)) return sign | 0x7e00;
+    if (magnitude >= 65520.f) return sign | 0x7c00;
+    // Subnormal halves count units of 2^-24; 1024 units is the smallest
+    // normal half, which the same code encodes.
+    if (magnitude < 0x1p-14f) return sign | static_cast<uint16_t>(lrintf(magnitude * 0x1p24f));
+    const uint32_t bits = floatBits(magnitude);
+    const uint32_t rounded = bits + 0xfff + ((bits >> 13) & 1);
+    return sign | static_cast<uint16_t>((rounded - ((127 - 15) << 23)) >> 13);
+}
+
+// Branch-free so that the decoding loops vectorize.
+inline float fromHalf(uint16_t half) {
+    const uint32_t sign = static_cast<uint32_t>(half & 0x8000) << 16;
+    const uint32_t magnitude = half & 0x7fff;
+    // Moved into a float, the half exponent is 112 too small; the product
+    // also normalizes subnormal halves.
+    float value = bitsFloat(magnitude << 13) * 0x1p112f;
+    value = magnitude >= 0x7c00 ? bitsFloat(0x7f800000 | (magnitude << 13)) : value;
+    return bitsFloat(floatBits(value) | sign);
+}
+
+uint16_t toBFloat(float value) {
+    const uint32_t bits = floatBits(value);
+    if (isnan(value)) return static_cast<uint16_t>((bits >> 16) | 0x40);
+    return static_cast<uint16_t>((bits + 0x7fff + ((bits >> 16) & 1)) >> 16);
+}
+
+inline float fromBFloat(uint16_t value) {
+    return bitsFloat(static_cast<uint32_t>(value) << 16);
+}
+
+void decodeColumn(PointStorage format, const uint16_t* codes, size_t count, float scale, float offset, float* values) {
+    switch (format) {
+        case PointStorage::Float16:
+            for (size_t i = 0; i < count; i++) values[i] = fromHalf(codes[i]);
+            break;
+        case PointStorage::BFloat16:
+            for (size_t i = 0; i < count; i++) values[i] = fromBFloat(codes[i]);
+            break;
+        default:
+            for (size_t i = 0; i < count; i++) values[i] = offset + scale * static_cast<int16_t>(codes[i]);
+    }
+}
+
+// The same loops on 8 lanes; halves go through the F16C conversion.
+__attribute__((target("avx2,f16c")))
+void decodeColumnAvx2(PointStorage format, const uint16_t* codes, size_t count, float scale, float offset,
+                      float* values) {
+    switch (format) {
+        case PointStorage::Float16: {
+            size_t i = 0;
+            for (; i + 8 <= count; i += 8) {
+                __m128i half = _mm_loadu_si128(reinterpret_cast<const __m128i*>(codes + i));
+                _mm256_storeu_ps(values + i, _mm256_cvtph_ps(half));
+            }
+            for (; i < count; i++) values[i] = fromHalf(codes[i]);
+            break;
+        }
+        case PointStorage::BFloat16:
+            for (size_t i = 0; i < count; i++) values[i] = fromBFloat(codes[i]);
+            break;
+        default:
+            for (size_t i = 0; i < count; i++) values[i] = offset + scale * static_cast<int16_t>(codes[i]);
+    }
+}
+
+}
+
+const char* storageName(PointStorage storage) {
+    switch (storage) {
+        case PointStorage::Float16: return "fp16";
+        case PointStorage::BFloat16: return "bf16";
+        case PointStorage::Int16: return "int16";
+        default: return "fp32";
+    }
+}
+
+CompactPoints::CompactPoints(const DataPoints& points, PointStorage storage)
+        : format(storage), pointNum(points.size()), columns(points.dimension()),
+          avx2(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("f16c")) {
+    const int dimension = points.dimension();
+    if (format == PointStorage::Int16) {
+        scale.assign(dimension, 1);
+        offset.assign(dimension, 0);
+        for (int d = 0; d < dimension; d++) {
+            float lowest = HUGE_VALF;
+            float highest = -HUGE_VALF;
+            for (float value : points[d]) {
+                if (!isfinite(value)) continue;
+                lowest = min(lowest, value);
+                highest = max(highest, value);
+            }
+            if (lowest > highest) continue;
+            offset[d] = static_cast<float>((static_cast<double>(lowest) + highest) / 2);
+            const double range = (static_cast<double>(highest) - lowest) / (2 * INT16_LIMIT);
+            if (range > 0) scale[d] = static_cast<float>(range);
+        }
+    }
+    for (int d = 0; d < dimension; d++) {
+        const FloatColumn& column = points[d];
+        vector<uint16_t>& codes = columns[d];
+        codes.resize(pointNum);
+        for (size_t i = 0; i < pointNum; i++) {
+            switch (format) {
+                case PointStorage::Float16:
+                    codes[i] = toHalf(column[i]);
+                    break;
+                case PointStorage::BFloat16:
+                    codes[i] = toBFloat(column[i]);
+                    break;
+                default: {
+                    const double code = nearbyint((static_cast<double>(column[i]) - offset[d]) / scale[d]);
+                    const int clamped = static_cast<int>(max<double>(-INT16_LIMIT, min<double>(INT16_LIMIT, code)));
+                    codes[i] = static_cast<uint16_t>(static_cast<int16_t>(clamped));
+                }
+            }
+        }
+    }
+}
+
+void CompactPoints::decode(int d, size_t first, size_t count, float* values) const {
+    const float columnScale = format == PointStorage::Int16 ? scale[d] : 1;
+    const float columnOffset = format == PointStorage::Int16 ? offset[d] : 0;
+    if (avx2) {
+        decodeColumnAvx2(format, columns[d].data() + first, count, columnScale, columnOffset, values);
+    } else {
+        decodeColumn(format, columns[d].data() + first, count, columnScale, columnOffset, values);
+    }
+}
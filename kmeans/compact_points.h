@@ -0,0 +1,45 @@
+#ifndef K_MEANS_COMPACT_POINTS_H
+#define K_MEANS_COMPACT_POINTS_H
+
+#include "data_points.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// How the coordinates of the points are kept in memory. Float32 is the
+// DataPoints layout; the others take 16 bits per coordinate:
+// - Float16: IEEE half precision, 11 significant bits, up to 65504;
+// - BFloat16: the upper half of a float, 8 significant bits, any range;
+// - Int16: integers scaled to the range of each dimension, measured when the
+//   points are converted.
+enum class PointStorage { Float32, Float16, BFloat16, Int16 };
+
+const char* storageName(PointStorage storage);
+
+// Points stored column by column in one of the 16-bit formats. They are
+// decoded to float block by block, so that only half the bytes of the float
+// layout are streamed from memory at every iteration.
+class CompactPoints {
+public:
+    // `storage` must not be Float32.
+    CompactPoints(const DataPoints& points, PointStorage storage);
+
+    PointStorage storage() const { return format; }
+    int dimension() const { return static_cast<int>(columns.size()); }
+    std::size_t size() const { return pointNum; }
+    std::size_t bytesPerPoint() const { return columns.size() * sizeof(std::uint16_t); }
+
+    // Writes coordinate `d` of points [first, first + count) to `values`.
+    void decode(int d, std::size_t first, std::size_t count, float* values) const;
+
+private:
+    PointStorage format;
+    std::size_t pointNum;
+    std::vector<std::vector<std::uint16_t>> columns;
+    // Int16 only: coordinate = offset + scale * code.
+    std::vector<float> scale;
+    std::vector<float> offset;
+    bool avx2;
+};
+
+#endif //K_MEANS_COMPACT_POINTS_H
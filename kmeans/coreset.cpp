@@ -0,0 +1,139 @@
+#include "coreset.h"
+#include "assignment_kernel.h"
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+// Sums are taken per fixed-size chunk and added in order, so the coreset
+// does not depend on how OpenMP splits the work.
+const size_t CORESET_CHUNK_SIZE = 1 << 14;
+
+// Stateless generator for the per-point draws, as in k-means|| seeding.
+double uniform(uint64_t seed, uint64_t index) {
+    uint64_t z = seed + 0x9E3779B97F4A7C15ULL * (index + 1);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z ^= z >> 31;
+    return (z >> 11) * 0x1.0p-53;
+}
+
+}
+
+bool buildCoreset(const DataPoints& points, const CoresetOptions& options, Coreset& coreset) {
+    const size_t pointNum = points.size();
+    const int dimension = points.dimension();
+    if (pointNum == 0 || options.size == 0) {
+        cerr << "Error: a coreset needs a positive size and at least one point" << endl;
+        return false;
+    }
+    const size_t chunkNum = (pointNum + CORESET_CHUNK_SIZE - 1) / CORESET_CHUNK_SIZE;
+
+    // First pass: sums of the coordinates and of the squared norms, taken
+    // relative to the first point so that data far from the origin does not
+    // cancel out when the cost is derived from them.
+    vector<double> chunkSums(chunkNum * (dimension + 1));
+#pragma omp parallel for schedule(dynamic, 1) num_threads(options.threadNum)
+    for (long chunk = 0; chunk < static_cast<long>(chunkNum); chunk++) {
+        double* sums = chunkSums.data() + chunk * (dimension + 1);
+        const size_t begin = chunk * CORESET_CHUNK_SIZE;
+        const size_t end = min(pointNum, begin + CORESET_CHUNK_SIZE);
+        for (int d = 0; d < dimension; d++) {
+            const float* column = points[d].data();
+            double sum = 0;
+            double squaredSum = 0;
+            for (size_t i = begin; i < end; i++) {
+                const double coordinate = column[i] - column[0];
+                sum += coordinate;
+                squaredSum += coordinate * coordinate;
+            }
+            sums[d] = sum;
+            sums[dimension] += squaredSum;
+        }
+    }
+    vector<double> total(dimension + 1, 0);
+    for (size_t chunk = 0; chunk < chunkNum; chunk++) {
+        for (int d = 0; d <= dimension; d++) total[d] += chunkSums[chunk * (dimension + 1) + d];
+    }
+    vector<float> mean(dimension);
+    double cost = total[dimension];
+    for (int d = 0; d < dimension; d++) {
+        const double shiftedMean = total[d] / pointNum;
+        cost -= pointNum * shiftedMean * shiftedMean;
+        mean[d] = static_cast<float>(points[d][0] + shiftedMean);
+    }
+
+    // Second pass: point i is kept with probability
+    // size * (1/2 * 1/pointNum + 1/2 * d(i, mean)² / cost), capped at 1.
+    const double sampleSize = static_cast<double>(options.size);
+    const double uniformShare = 0.5 * sampleSize / pointNum;
+    const double costShare = cost > 0 ? 0.5 * sampleSize / cost : 0;
+    vector<vector<size_t>> chunkSamples(chunkNum);
+    vector<vector<float>> chunkWeights(chunkNum);
+#pragma omp parallel for schedule(dynamic, 1) num_threads(options.threadNum)
+    for (long chunk = 0; chunk < static_cast<long>(chunkNum); chunk++) {
+        chunkSamples[chunk].clear();
+        chunkWeights[chunk].clear();
+        const size_t begin = chunk * CORESET_CHUNK_SIZE;
+        const size_t end = min(pointNum, begin + CORESET_CHUNK_SIZE);
+        for (size_t i = begin; i < end; i++) {
+            float distance = 0;
+            for (int d = 0; d < dimension; d++) {
+                const float difference = points[d][i] - mean[d];
+                distance += difference * difference;
+            }
+            // Without any spread every point gets the uniform share twice.
+            const double probability = min(1.0, cost > 0 ? uniformShare + costShare * distance : 2 * uniformShare);
+            if (uniform(options.seed, i) < probability) {
+                chunkSamples[chunk].push_back(i);
+                chunkWeights[chunk].push_back(static_cast<float>(1 / probability));
+            }
+        }
+    }
+
+    coreset.points = DataPoints(dimension);
+    coreset.weights.clear();
+    for (size_t chunk = 0; chunk < chunkNum; chunk++) {
+        for (size_t index : chunkSamples[chunk]) coreset.points.pushPoint(points, index);
+        coreset.weights.insert(coreset.weights.end(), chunkWeights[chunk].begin(), chunkWeights[chunk].end());
+    }
+    if (coreset.points.size() == 0) {
+        cerr << "Error: the coreset drew no point" << endl;
+        return false;
+    }
+    return true;
+}
+
+double clusteringCost(const DataPoints& points, const DataPoints& centroids, int threadNum) {
+    const int dimension = points.dimension();
+    const int clusterNum = static_cast<int>(centroids.size());
+    const size_t pointNum = points.size();
+    const AssignmentKernel kernel = selectAssignmentKernel(dimension, clusterNum);
+    const vector<const float*> pointColumns = points.columnData();
+    const vector<const float*> centroidColumns = centroids.columnData();
+    const size_t blockNum = (pointNum + ASSIGNMENT_BLOCK_SIZE - 1) / ASSIGNMENT_BLOCK_SIZE;
+    vector<double> partCosts(threadNum);
+#pragma omp parallel for schedule(static) num_threads(threadNum)
+    for (int part = 0; part < threadNum; part++) {
+        int labels[ASSIGNMENT_BLOCK_SIZE];
+        float distances[ASSIGNMENT_BLOCK_SIZE];
+        float secondDistances[ASSIGNMENT_BLOCK_SIZE];
+        const size_t firstBlock = part * blockNum / threadNum;
+        const size_t lastBlock = (part + 1) * blockNum / threadNum;
+        for (size_t block = firstBlock * ASSIGNMENT_BLOCK_SIZE; block < lastBlock * ASSIGNMENT_BLOCK_SIZE;
+             block += ASSIGNMENT_BLOCK_SIZE) {
+            const size_t blockSize = min(ASSIGNMENT_BLOCK_SIZE, pointNum - block);
+            kernel.assignWithDistances(pointColumns.data(), block, blockSize, centroidColumns.data(), dimension,
+                                       clusterNum, labels, distances, secondDistances);
+            double blockCost = 0;
+            for (size_t i = 0; i < blockSize; i++) blockCost += distances[i];
+            partCosts[part] += blockCost;
+        }
+    }
+    double cost = 0;
+    for (double partCost : partCosts) cost += partCost;
+    return cost;
+}
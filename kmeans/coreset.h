@@ -0,0 +1,36 @@
+#ifndef K_MEANS_CORESET_H
+#define K_MEANS_CORESET_H
+
+#include "data_points.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A weighted summary of a dataset: the k-means cost of any set of centroids
+// on the weighted points estimates their cost on the whole dataset.
+struct Coreset {
+    DataPoints points;
+    std::vector<float> weights;
+};
+
+struct CoresetOptions {
+    // Expected number of points; the actual one varies a little around it.
+    std::size_t size = 0;
+    std::uint64_t seed = 0;
+    int threadNum = 1;
+};
+
+// Lightweight coreset (Bachem et al., 2018) in two parallel passes: the first
+// sums the points and their squared norms, giving the mean and the cost of
+// the points around it; the second keeps every point independently with a
+// probability that mixes a uniform part with its share of that cost, and
+// weighs it by the inverse of the probability. Far away points, which move
+// the centroids the most, are therefore kept more often. The draws depend
+// only on the seed and the row, not on the number of threads.
+bool buildCoreset(const DataPoints& points, const CoresetOptions& options, Coreset& coreset);
+
+// Sum of the squared distances of the points to their nearest centroid, on
+// threadNum threads.
+double clusteringCost(const DataPoints& points, const DataPoints& centroids, int threadNum);
+
+#endif //K_MEANS_CORESET_H
@@ -0,0 +1,81 @@
+#ifndef K_MEANS_CSV_PARSER_H
+#define K_MEANS_CSV_PARSER_H
+
+#include <charconv>
+#include <cstring>
+
+// Line parser shared by the CSV loader and the batch sampler. It accepts the
+// same lines as "stream >> x >> delimiter >> y >> delimiter >> z", for any
+// number of coordinates.
+namespace csv {
+
+inline bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+inline bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+inline const char* skipSpaces(const char* cursor, const char* end) {
+    while (cursor < end && isSpace(*cursor)) cursor++;
+    return cursor;
+}
+
+// Same acceptance rules as "stream >> float": leading blanks, optional sign,
+// decimal digits. from_chars would also take "inf"/"nan", the stream does not.
+inline const char* parseCoordinate(const char* cursor, const char* end, float& value) {
+    cursor = skipSpaces(cursor, end);
+    if (cursor < end && *cursor == '+') {
+        cursor++;
+        if (cursor < end && *cursor == '-') return nullptr;
+    }
+    const char* digits = (cursor < end && *cursor == '-') ? cursor + 1 : cursor;
+    if (digits >= end || !(isDigit(*digits) || *digits == '.')) return nullptr;
+    auto result = std::from_chars(cursor, end, value);
+    if (result.ec != std::errc()) return nullptr;
+    return result.ptr;
+}
+
+// Same as "stream >> char": skips blanks and consumes any other character.
+inline const char* parseDelimiter(const char* cursor, const char* end) {
+    cursor = skipSpaces(cursor, end);
+    return cursor < end ? cursor + 1 : nullptr;
+}
+
+// Reads `dimension` coordinates separated by delimiters; anything after the
+// last one is ignored.
+inline bool parseLine(const char* cursor, const char* end, float* coordinates, int dimension) {
+    for (int d = 0; d < dimension; d++) {
+        if (d > 0 && !(cursor = parseDelimiter(cursor, end))) return false;
+        if (!(cursor = parseCoordinate(cursor, end, coordinates[d]))) return false;
+    }
+    return true;
+}
+
+// Number of coordinates parseLine() can read from the line.
+inline int countCoordinates(const char* cursor, const char* end) {
+    int count = 0;
+    float value;
+    while ((count == 0 || (cursor = parseDelimiter(cursor, end))) && (cursor = parseCoordinate(cursor, end, value))) {
+        count++;
+    }
+    return count;
+}
+
+// Coordinate count of the first line holding at least one coordinate, 0 if
+// there is none. Header lines are skipped this way.
+inline int detectDimension(const char* text, const char* end) {
+    while (text < end) {
+        auto lineEnd = static_cast<const char*>(std::memchr(text, '\n', end - text));
+        if (!lineEnd) lineEnd = end;
+        int dimension = countCoordinates(text, lineEnd);
+        if (dimension > 0) return dimension;
+        text = lineEnd + 1;
+    }
+    return 0;
+}
+
+}
+
+#endif //K_MEANS_CSV_PARSER_H
@@ -0,0 +1,151 @@
+#ifndef K_MEANS_DATA_POINTS_H
+#define K_MEANS_DATA_POINTS_H
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// A column of coordinates. It either owns its values or points into memory
+// owned by someone else (e.g. a mapped binary dataset) which is kept alive
+// through `storage`. Any operation that changes the size first copies
+// external values into owned memory.
+class FloatColumn {
+public:
+    FloatColumn() = default;
+    FloatColumn(const FloatColumn& other) : owned(other.begin(), other.end()) { sync(); }
+    FloatColumn(FloatColumn&& other) noexcept { *this = std::move(other); }
+
+    FloatColumn& operator=(const FloatColumn& other) {
+        if (this != &other) {
+            storage.reset();
+            owned.assign(other.begin(), other.end());
+            sync();
+        }
+        return *this;
+    }
+
+    FloatColumn& operator=(FloatColumn&& other) noexcept {
+        owned = std::move(other.owned);
+        storage = std::move(other.storage);
+        values = other.values;
+        count = other.count;
+        other.values = nullptr;
+        other.count = 0;
+        return *this;
+    }
+
+    float& operator[](std::size_t i) { return values[i]; }
+    const float& operator[](std::size_t i) const { return values[i]; }
+    float* data() { return values; }
+    const float* data() const { return values; }
+    float* begin() { return values; }
+    float* end() { return values + count; }
+    const float* begin() const { return values; }
+    const float* end() const { return values + count; }
+    std::size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    bool isExternal() const { return storage != nullptr; }
+
+    void adopt(float* externalValues, std::size_t externalCount, std::shared_ptr<void> owner) {
+        owned.clear();
+        owned.shrink_to_fit();
+        storage = std::move(owner);
+        values = externalValues;
+        count = externalCount;
+    }
+
+    void resize(std::size_t newCount) {
+        detach();
+        owned.resize(newCount);
+        sync();
+    }
+
+    void clear() { resize(0); }
+
+    // Keeps only values [first, first + keptCount); external values are not
+    // copied.
+    void keep(std::size_t first, std::size_t keptCount) {
+        if (storage) {
+            values += first;
+            count = keptCount;
+            return;
+        }
+        owned.erase(owned.begin() + first + keptCount, owned.end());
+        owned.erase(owned.begin(), owned.begin() + first);
+        owned.shrink_to_fit();
+        sync();
+    }
+
+    void push_back(float value) {
+        detach();
+        owned.push_back(value);
+        sync();
+    }
+
+    template<typename Iterator>
+    void insert(float* position, Iterator first, Iterator last) {
+        std::size_t offset = position - values;
+        detach();
+        owned.insert(owned.begin() + offset, first, last);
+        sync();
+    }
+
+private:
+    void detach() {
+        if (storage) {
+            owned.assign(values, values + count);
+            storage.reset();
+        }
+    }
+
+    void sync() {
+        values = owned.data();
+        count = owned.size();
+    }
+
+    std::vector<float> owned;
+    std::shared_ptr<void> storage;
+    float* values = nullptr;
+    std::size_t count = 0;
+};
+
+// Points stored column by column: column d holds coordinate d of every
+// point, so the dimension is the number of columns.
+struct DataPoints {
+    std::vector<FloatColumn> columns;
+
+    DataPoints() = default;
+    explicit DataPoints(int dimension) : columns(dimension) {}
+
+    int dimension() const { return static_cast<int>(columns.size()); }
+    std::size_t size() const { return columns.empty() ? 0 : columns.front().size(); }
+    bool empty() const { return size() == 0; }
+    FloatColumn& operator[](int d) { return columns[d]; }
+    const FloatColumn& operator[](int d) const { return columns[d]; }
+
+    void resize(std::size_t count) {
+        for (auto& column : columns) column.resize(count);
+    }
+
+    void keepRows(std::size_t first, std::size_t count) {
+        for (auto& column : columns) column.keep(first, count);
+    }
+
+    void pushPoint(const float* coordinates) {
+        for (std::size_t d = 0; d < columns.size(); d++) columns[d].push_back(coordinates[d]);
+    }
+
+    // Appends point `index` of `other`, which has the same dimension.
+    void pushPoint(const DataPoints& other, std::size_t index) {
+        for (std::size_t d = 0; d < columns.size(); d++) columns[d].push_back(other.columns[d][index]);
+    }
+
+    // First value of every column, as the assignment kernels take them.
+    std::vector<const float*> columnData() const {
+        std::vector<const float*> data;
+        for (const auto& column : columns) data.push_back(column.data());
+        return data;
+    }
+};
+
+#endif //K_MEANS_DATA_POINTS_H
@@ -0,0 +1,161 @@
+#include "dataset_loader.h"
+#include "binary_dataset.h"
+#include "csv_parser.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <omp.h>
+#include <sys/mman.h>
+
+using namespace std;
+using namespace chrono;
+
+namespace {
+
+size_t countLines(const char* begin, const char* end) {
+    if (begin == end) return 0;
+    auto lines = static_cast<size_t>(count(begin, end, '\n'));
+    return *(end - 1) == '\n' ? lines : lines + 1;
+}
+
+// Start of the first line that starts at `offset` or after it.
+size_t lineStart(const char* text, size_t size, size_t offset) {
+    if (offset == 0) return 0;
+    auto newline = static_cast<const char*>(memchr(text + offset - 1, '\n', size - offset + 1));
+    return newline ? newline - text + 1 : size;
+}
+
+}
+
+bool parseCsvText(const char* text, size_t size, DataPoints& dataset, size_t& loadedRows) {
+    if (dataset.dimension() == 0) {
+        const int dimension = csv::detectDimension(text, text + size);
+        if (dimension == 0) return false;
+        dataset = DataPoints(dimension);
+    }
+    const int dimension = dataset.dimension();
+
+    const int chunkNum = size == 0 ? 1 : omp_get_max_threads() * 4;
+    vector<size_t> chunkBegin(chunkNum + 1, size);
+    chunkBegin[0] = 0;
+    for (int c = 1; c < chunkNum; c++) {
+        size_t approximate = max(size / chunkNum * c, chunkBegin[c - 1]);
+        auto newline = static_cast<const char*>(memchr(text + approximate, '\n', size - approximate));
+        chunkBegin[c] = newline ? newline - text + 1 : size;
+    }
+
+    vector<size_t> chunkRows(chunkNum + 1, 0);
+#pragma omp parallel for schedule(static)
+    for (int c = 0; c < chunkNum; c++) {
+        chunkRows[c + 1] = countLines(text + chunkBegin[c], text + chunkBegin[c + 1]);
+    }
+    for (int c = 0; c < chunkNum; c++) {
+        chunkRows[c + 1] += chunkRows[c];
+    }
+
+    const size_t firstRow = dataset.size();
+    dataset.resize(firstRow + chunkRows[chunkNum]);
+    vector<float*> columns(dimension);
+    for (int d = 0; d < dimension; d++) columns[d] = dataset[d].data() + firstRow;
+
+    vector<size_t> validRows(chunkNum, 0);
+#pragma omp parallel for schedule(dynamic, 1)
+    for (int c = 0; c < chunkNum; c++) {
+        const char* cursor = text + chunkBegin[c];
+        const char* chunkEnd = text + chunkBegin[c + 1];
+        vector<float> point(dimension);
+        size_t row = chunkRows[c];
+        while (cursor < chunkEnd) {
+            auto lineEnd = static_cast<const char*>(memchr(cursor, '\n', chunkEnd - cursor));
+            if (!lineEnd) lineEnd = chunkEnd;
+            if (csv::parseLine(cursor, lineEnd, point.data(), dimension)) {
+                for (int d = 0; d < dimension; d++) columns[d][row] = point[d];
+                row++;
+            }
+            cursor = lineEnd + 1;
+        }
+        validRows[c] = row - chunkRows[c];
+    }
+
+    // Skipped lines leave holes at the end of each chunk's slot range.
+    loadedRows = 0;
+    for (int c = 0; c < chunkNum; c++) {
+        if (loadedRows != chunkRows[c]) {
+            for (float* column : columns) {
+                memmove(column + loadedRows, column + chunkRows[c], validRows[c] * sizeof(float));
+            }
+        }
+        loadedRows += validRows[c];
+    }
+    dataset.resize(firstRow + loadedRows);
+    return true;
+}
+
+bool readDatasetFromFile(DataPoints& dataset, const string& fullPath) {
+    auto file = make_shared<MappedFile>(fullPath);
+    if (!file->isOpen()) {
+        cerr << "Error: Unable to open file " << fullPath << endl;
+        return false;
+    }
+    cout << "Reading the dataset..." << endl;
+    auto startTime = high_resolution_clock::now();
+
+    size_t loadedRows;
+    if (isBinaryDataset(*file)) {
+        size_t firstRow = dataset.size();
+        if (!mapBinaryDataset(dataset, file, fullPath)) return false;
+        loadedRows = dataset.size() - firstRow;
+    } else {
+        file->advise(MADV_SEQUENTIAL);
+        if (!parseCsvText(file->data(), file->size(), dataset, loadedRows)) {
+            cerr << "Error: No coordinates found in " << fullPath << endl;
+            return false;
+        }
+    }
+
+    auto endTime = high_resolution_clock::now();
+    double seconds = duration_cast<microseconds>(endTime - startTime).count() / 1e6;
+    cout << "Dataset loaded from " << fullPath << endl;
+    cout << "Loaded " << loadedRows << " points of dimension " << dataset.dimension() << " in " << seconds * 1000 << " ms";
+    if (seconds > 0) {
+        cout << " (" << loadedRows / seconds << " rows/s, " << file->size() / seconds / (1024 * 1024) << " MB/s)";
+    }
+    cout << endl;
+    return true;
+}
+
+bool readDatasetPart(DataPoints& dataset, const string& fullPath, int part, int partNum) {
+    auto file = make_shared<MappedFile>(fullPath);
+    if (!file->isOpen()) {
+        cerr << "Error: Unable to open file " << fullPath << endl;
+        return false;
+    }
+    cout << "Reading part " << part + 1 << " of " << partNum << " of the dataset..." << endl;
+    auto startTime = high_resolution_clock::now();
+
+    size_t bytes;
+    if (isBinaryDataset(*file)) {
+        // The mapping only reads the pages of the rows that are kept.
+        if (!mapBinaryDataset(dataset, file, fullPath)) return false;
+        const size_t rows = dataset.size();
+        const size_t first = part * rows / partNum;
+        dataset.keepRows(first, (part + 1) * rows / partNum - first);
+        bytes = dataset.size() * dataset.dimension() * sizeof(float);
+    } else {
+        const size_t begin = lineStart(file->data(), file->size(), part * file->size() / partNum);
+        const size_t end = lineStart(file->data(), file->size(), (part + 1) * file->size() / partNum);
+        bytes = end - begin;
+        file->advise(MADV_SEQUENTIAL, begin, bytes);
+        size_t loadedRows;
+        if (!parseCsvText(file->data() + begin, bytes, dataset, loadedRows)) dataset = DataPoints();
+    }
+
+    auto endTime = high_resolution_clock::now();
+    double seconds = duration_cast<microseconds>(endTime - startTime).count() / 1e6;
+    cout << "Loaded " << dataset.size() << " points of dimension " << dataset.dimension() << " in "
+         << seconds * 1000 << " ms";
+    if (seconds > 0) cout << " (" << bytes / seconds / (1024 * 1024) << " MB/s)";
+    cout << endl;
+    return true;
+}
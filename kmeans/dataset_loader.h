@@ -0,0 +1,28 @@
+#ifndef K_MEANS_DATASET_LOADER_H
+#define K_MEANS_DATASET_LOADER_H
+
+#include "data_points.h"
+#include <cstddef>
+#include <string>
+
+// Loads a dataset into the SoA arrays. Binary datasets (see binary_dataset.h)
+// are mapped without copying. CSV files are memory-mapped and split into
+// newline-aligned chunks that are parsed concurrently. An empty dataset takes
+// the column count of the first line holding numbers; lines with fewer
+// numbers than the dataset's dimension (e.g. the header) are skipped.
+bool readDatasetFromFile(DataPoints& dataset, const std::string& fullPath);
+
+// Loads part `part` of `partNum` of a dataset into an empty `dataset`, without
+// parsing or copying the rest of the file: rows [part * rows / partNum,
+// (part + 1) * rows / partNum) of a binary file, or the lines of a CSV file
+// that start in the part-th of partNum equal byte ranges. The parts follow
+// each other, so together they hold the rows of readDatasetFromFile. A part
+// without any valid line is left with dimension 0.
+bool readDatasetPart(DataPoints& dataset, const std::string& fullPath, int part, int partNum);
+
+// Appends the points of CSV `text` to `dataset`, parsing chunks of lines
+// concurrently. An empty dataset takes the dimension of the first line
+// holding numbers; returns false if there is none.
+bool parseCsvText(const char* text, std::size_t size, DataPoints& dataset, std::size_t& loadedRows);
+
+#endif //K_MEANS_DATASET_LOADER_H
@@ -0,0 +1,67 @@
+#include "dataset_sampler.h"
+#include "binary_dataset.h"
+#include "csv_parser.h"
+#include <cstring>
+#include <iostream>
+#include <sys/mman.h>
+#include <vector>
+
+using namespace std;
+
+// Consecutive invalid lines tolerated before a CSV file is declared empty.
+static const int MAX_SAMPLING_FAILURES = 1000;
+
+DatasetSampler::DatasetSampler(const string& fullPath) : file(make_shared<MappedFile>(fullPath)) {
+    if (!file->isOpen()) {
+        cerr << "Error: Unable to open file " << fullPath << endl;
+        return;
+    }
+    file->advise(MADV_RANDOM);
+    binary = isBinaryDataset(*file);
+    if (binary) {
+        if (!mapBinaryDataset(rows, file, fullPath)) return;
+    } else {
+        const int dimension = csv::detectDimension(file->data(), file->data() + file->size());
+        if (dimension == 0) {
+            cerr << "Error: No coordinates found in " << fullPath << endl;
+            return;
+        }
+        rows = DataPoints(dimension);
+    }
+    opened = true;
+}
+
+bool DatasetSampler::sampleLine(mt19937_64& generator, float* coordinates) const {
+    const char* text = file->data();
+    const size_t size = file->size();
+    for (int attempt = 0; attempt < MAX_SAMPLING_FAILURES && size > 0; attempt++) {
+        // Take the line that contains a random byte.
+        size_t offset = generator() % size;
+        auto newline = static_cast<const char*>(memrchr(text, '\n', offset));
+        const char* lineBegin = newline ? newline + 1 : text;
+        auto lineEnd = static_cast<const char*>(memchr(lineBegin, '\n', text + size - lineBegin));
+        if (!lineEnd) lineEnd = text + size;
+        if (csv::parseLine(lineBegin, lineEnd, coordinates, rows.dimension())) return true;
+    }
+    return false;
+}
+
+bool DatasetSampler::sample(mt19937_64& generator, size_t count, DataPoints& batch) const {
+    const int dimension = rows.dimension();
+    if (batch.dimension() != dimension) batch = DataPoints(dimension);
+    batch.resize(count);
+    if (binary) {
+        if (rows.empty()) return false;
+        for (size_t i = 0; i < count; i++) {
+            size_t row = generator() % rows.size();
+            for (int d = 0; d < dimension; d++) batch[d][i] = rows[d][row];
+        }
+        return true;
+    }
+    vector<float> point(dimension);
+    for (size_t i = 0; i < count; i++) {
+        if (!sampleLine(generator, point.data())) return false;
+        for (int d = 0; d < dimension; d++) batch[d][i] = point[d];
+    }
+    return true;
+}
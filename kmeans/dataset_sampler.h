@@ -0,0 +1,40 @@
+#ifndef K_MEANS_DATASET_SAMPLER_H
+#define K_MEANS_DATASET_SAMPLER_H
+
+#include "data_points.h"
+#include "mapped_file.h"
+#include <cstddef>
+#include <memory>
+#include <random>
+#include <string>
+
+// Draws random batches of points straight from a dataset file, so that the
+// whole dataset never has to be loaded. Binary files are sampled by row;
+// CSV files by taking the line around a random byte (long lines are
+// therefore slightly more likely, which is fine for mini-batches).
+// sample() only reads the mapping and may be called from several threads
+// with different generators.
+class DatasetSampler {
+public:
+    explicit DatasetSampler(const std::string& fullPath);
+
+    bool isOpen() const { return opened; }
+    bool isBinary() const { return binary; }
+    int dimension() const { return rows.dimension(); }
+    std::size_t fileSize() const { return file ? file->size() : 0; }
+
+    // Replaces the content of `batch` with `count` points drawn with
+    // replacement; fails when the file holds no valid line.
+    bool sample(std::mt19937_64& generator, std::size_t count, DataPoints& batch) const;
+
+private:
+    bool sampleLine(std::mt19937_64& generator, float* coordinates) const;
+
+    std::shared_ptr<MappedFile> file;
+    // Mapped points of a binary file; only the dimension for a CSV file.
+    DataPoints rows;
+    bool binary = false;
+    bool opened = false;
+};
+
+#endif //K_MEANS_DATASET_SAMPLER_H
@@ -0,0 +1,192 @@
+#include "deduplication.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+// Rows are split into this many partitions by the top bits of their hash;
+// equal rows land in the same partition, which one thread merges.
+const int PARTITION_BITS = 8;
+const int PARTITION_NUM = 1 << PARTITION_BITS;
+const uint32_t NO_ROW = UINT32_MAX;
+
+// Cell of a coordinate. Coordinates without a cell index (infinite, NaN or
+// beyond 64 bits once divided by the quantum) and every coordinate with a
+// quantum of 0 are keyed by their bits, in a range no cell index reaches.
+int64_t cellKey(float coordinate, float quantum) {
+    if (quantum > 0) {
+        const double cell = floor(static_cast<double>(coordinate) / quantum);
+        if (fabs(cell) < 9e18) return static_cast<int64_t>(cell);
+    }
+    // 0 and -0 are the same coordinate.
+    if (coordinate == 0) coordinate = 0;
+    uint32_t bits;
+    memcpy(&bits, &coordinate, sizeof(bits));
+    return INT64_MIN + bits;
+}
+
+uint64_t mix(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+bool sameCell(const float* first, const float* second, int dimension, float quantum) {
+    for (int d = 0; d < dimension; d++) {
+        if (cellKey(first[d], quantum) != cellKey(second[d], quantum)) return false;
+    }
+    return true;
+}
+
+// Cells of one partition: their hash, first slot, coordinate sums and rows.
+struct PartitionCells {
+    vector<uint64_t> hashes;
+    vector<size_t> firstSlots;
+    vector<double> sums;
+    vector<size_t> sizes;
+};
+
+}
+
+bool deduplicatePoints(const DataPoints& rows, const DeduplicationOptions& options, DeduplicatedPoints& deduplicated) {
+    const size_t rowNum = rows.size();
+    const int dimension = rows.dimension();
+    const int threadNum = options.threadNum;
+    const float quantum = options.quantum;
+    if (rowNum == 0 || rowNum >= NO_ROW) {
+        cerr << "Error: cannot deduplicate " << rowNum << " rows" << endl;
+        return false;
+    }
+
+    // Hashes of the rows, and how many rows of every part fall in every
+    // partition.
+    vector<uint64_t> hashes(rowNum);
+    vector<size_t> offsets(static_cast<size_t>(threadNum) * PARTITION_NUM, 0);
+#pragma omp parallel for schedule(static) num_threads(threadNum)
+    for (int part = 0; part < threadNum; part++) {
+        size_t* counts = offsets.data() + static_cast<size_t>(part) * PARTITION_NUM;
+        const size_t first = part * rowNum / threadNum;
+        const size_t last = (part + 1) * rowNum / threadNum;
+        for (size_t i = first; i < last; i++) {
+            uint64_t hash = 0;
+            for (int d = 0; d < dimension; d++) {
+                hash = mix(hash + 0x9E3779B97F4A7C15ULL + static_cast<uint64_t>(cellKey(rows[d][i], quantum)));
+            }
+            hashes[i] = hash;
+            counts[hash >> (64 - PARTITION_BITS)]++;
+        }
+    }
+
+    // Rows grouped by partition, in row order within each one: the parts are
+    // contiguous and scattered to consecutive slots. The hash and the
+    // coordinates go along, so that merging a partition stays in cache.
+    vector<size_t> partitionBegins(PARTITION_NUM + 1, 0);
+    size_t offset = 0;
+    for (int partition = 0; partition < PARTITION_NUM; partition++) {
+        partitionBegins[partition] = offset;
+        for (int part = 0; part < threadNum; part++) {
+            const size_t count = offsets[static_cast<size_t>(part) * PARTITION_NUM + partition];
+            offsets[static_cast<size_t>(part) * PARTITION_NUM + partition] = offset;
+            offset += count;
+        }
+    }
+    partitionBegins[PARTITION_NUM] = offset;
+    vector<uint32_t> slotRows(rowNum);
+    vector<uint64_t> slotHashes(rowNum);
+    vector<float> slotCoordinates(rowNum * dimension);
+#pragma omp parallel for schedule(static) num_threads(threadNum)
+    for (int part = 0; part < threadNum; part++) {
+        size_t* next = offsets.data() + static_cast<size_t>(part) * PARTITION_NUM;
+        const size_t first = part * rowNum / threadNum;
+        const size_t last = (part + 1) * rowNum / threadNum;
+        for (size_t i = first; i < last; i++) {
+            const size_t slot = next[hashes[i] >> (64 - PARTITION_BITS)]++;
+            slotRows[slot] = i;
+            slotHashes[slot] = hashes[i];
+            for (int d = 0; d < dimension; d++) slotCoordinates[slot * dimension + d] = rows[d][i];
+        }
+    }
+    hashes = vector<uint64_t>();
+
+    // Cells of every partition through an open-addressing table, numbered
+    // in the order of their first row; slotCells receives the cell of every
+    // slot.
+    vector<PartitionCells> cells(PARTITION_NUM);
+    vector<uint32_t> slotCells(rowNum);
+#pragma omp parallel for schedule(dynamic, 1) num_threads(threadNum)
+    for (int partition = 0; partition < PARTITION_NUM; partition++) {
+        PartitionCells& partitionCells = cells[partition];
+        const size_t begin = partitionBegins[partition];
+        const size_t end = partitionBegins[partition + 1];
+        size_t capacity = 16;
+        while (capacity < 2 * (end - begin)) capacity *= 2;
+        vector<uint32_t> table(capacity, NO_ROW);
+        for (size_t slot = begin; slot < end; slot++) {
+            const uint64_t hash = slotHashes[slot];
+            const float* coordinates = slotCoordinates.data() + slot * dimension;
+            size_t probe = hash & (capacity - 1);
+            while (table[probe] != NO_ROW) {
+                const uint32_t cell = table[probe];
+                if (partitionCells.hashes[cell] == hash &&
+                    sameCell(slotCoordinates.data() + partitionCells.firstSlots[cell] * dimension, coordinates,
+                             dimension, quantum)) {
+                    break;
+                }
+                probe = (probe + 1) & (capacity - 1);
+            }
+            if (table[probe] == NO_ROW) {
+                table[probe] = static_cast<uint32_t>(partitionCells.hashes.size());
+                partitionCells.hashes.push_back(hash);
+                partitionCells.firstSlots.push_back(slot);
+                partitionCells.sums.resize(partitionCells.sums.size() + dimension, 0);
+                partitionCells.sizes.push_back(0);
+            }
+            const uint32_t cell = table[probe];
+            slotCells[slot] = cell;
+            partitionCells.sizes[cell]++;
+            for (int d = 0; d < dimension; d++) partitionCells.sums[cell * dimension + d] += coordinates[d];
+        }
+    }
+
+    // Points are numbered partition after partition, which depends on the
+    // rows alone.
+    vector<size_t> firstPoints(PARTITION_NUM + 1, 0);
+    for (int partition = 0; partition < PARTITION_NUM; partition++) {
+        firstPoints[partition + 1] = firstPoints[partition] + cells[partition].sizes.size();
+    }
+    const size_t pointNum = firstPoints[PARTITION_NUM];
+    deduplicated.points = DataPoints(dimension);
+    deduplicated.points.resize(pointNum);
+    deduplicated.weights.resize(pointNum);
+    deduplicated.rowPoints.resize(rowNum);
+#pragma omp parallel for schedule(dynamic, 1) num_threads(threadNum)
+    for (int partition = 0; partition < PARTITION_NUM; partition++) {
+        const PartitionCells& partitionCells = cells[partition];
+        const size_t firstPoint = firstPoints[partition];
+        for (size_t cell = 0; cell < partitionCells.sizes.size(); cell++) {
+            const double size = static_cast<double>(partitionCells.sizes[cell]);
+            for (int d = 0; d < dimension; d++) {
+                deduplicated.points[d][firstPoint + cell] =
+                        static_cast<float>(partitionCells.sums[cell * dimension + d] / size);
+            }
+            deduplicated.weights[firstPoint + cell] = static_cast<float>(size);
+        }
+        for (size_t slot = partitionBegins[partition]; slot < partitionBegins[partition + 1]; slot++) {
+            deduplicated.rowPoints[slotRows[slot]] = static_cast<uint32_t>(firstPoint + slotCells[slot]);
+        }
+    }
+    return true;
+}
+
+void expandLabels(const DeduplicatedPoints& deduplicated, const int* pointLabels, int threadNum,
+                  vector<int>& rowLabels) {
+    const size_t rowNum = deduplicated.rowPoints.size();
+    rowLabels.resize(rowNum);
+#pragma omp parallel for schedule(static) num_threads(threadNum)
+    for (size_t i = 0; i < rowNum; i++) rowLabels[i] = pointLabels[deduplicated.rowPoints[i]];
+}
@@ -0,0 +1,39 @@
+#ifndef K_MEANS_DEDUPLICATION_H
+#define K_MEANS_DEDUPLICATION_H
+
+#include "data_points.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// The distinct points of a dataset: rows whose coordinates fall in the same
+// cell of a grid with side `quantum` (or are identical, with a quantum of 0)
+// are collapsed into one point, the mean of the rows, weighed by their
+// number. Lloyd iterations on the weighted points (kMeansWeighted in
+// lloyd.h) then give the centroids of the rows, up to float rounding: the
+// cluster sums are those of the rows, and only the rows of a cell are
+// assigned together.
+struct DeduplicatedPoints {
+    DataPoints points;
+    std::vector<float> weights;
+    // Point of every original row.
+    std::vector<std::uint32_t> rowPoints;
+};
+
+struct DeduplicationOptions {
+    float quantum = 0;
+    int threadNum = 1;
+};
+
+// Hashes the quantized rows in parallel, splits them by hash into
+// partitions and merges the equal rows of every partition with a hash table.
+// The points and their order depend on the rows alone, not on the number of
+// threads.
+bool deduplicatePoints(const DataPoints& rows, const DeduplicationOptions& options, DeduplicatedPoints& deduplicated);
+
+// Labels of the original rows from the labels of the deduplicated points,
+// on threadNum threads.
+void expandLabels(const DeduplicatedPoints& deduplicated, const int* pointLabels, int threadNum,
+                  std::vector<int>& rowLabels);
+
+#endif //K_MEANS_DEDUPLICATION_H
@@ -0,0 +1,282 @@
+#include "filtering_engine.h"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+using namespace std;
+
+namespace {
+
+const size_t LEAF_SIZE = 32;
+// Subtrees above this depth become OpenMP tasks, each with its own
+// accumulator slot: 2^TASK_DEPTH slots in total.
+const int TASK_DEPTH = 6;
+const int SLOT_NUM = 1 << TASK_DEPTH;
+// Leaf scans are compiled for every dimension up to this one.
+const int FILTERING_MAX_DIMENSION = 8;
+// Relative margin applied to the pruning test, well above the rounding error
+// of the float squared distances used by the brute-force scan.
+const double BOUND_TOLERANCE = 1e-5;
+
+int subtreeNodes(size_t count) {
+    return count <= LEAF_SIZE ? 1 : 1 + subtreeNodes(count / 2) + subtreeNodes(count - count / 2);
+}
+
+int subtreeHeight(size_t count) {
+    return count <= LEAF_SIZE ? 1 : 1 + subtreeHeight(count - count / 2);
+}
+
+}
+
+FilteringEngine::FilteringEngine(const DataPoints& points, int threadNum)
+        : dimension(points.dimension()), ordered(points.dimension()), order(points.size()) {
+    if (points.empty()) return;
+    const int nodeNum = subtreeNodes(points.size());
+    height = subtreeHeight(points.size());
+    nodes.resize(nodeNum);
+    lower.resize(static_cast<size_t>(nodeNum) * dimension);
+    upper.resize(static_cast<size_t>(nodeNum) * dimension);
+    nodeSums.resize(static_cast<size_t>(nodeNum) * dimension);
+    iota(order.begin(), order.end(), 0);
+    ordered = points;
+    vector<float> cell(2 * dimension);
+    for (int d = 0; d < dimension; d++) {
+        auto range = minmax_element(points[d].begin(), points[d].end());
+        cell[d] = *range.first;
+        cell[dimension + d] = *range.second;
+    }
+#pragma omp parallel num_threads(threadNum)
+#pragma omp single
+    build(0, 0, points.size(), 0, cell);
+    // Leaves read their points contiguously.
+    for (int d = 0; d < dimension; d++) {
+#pragma omp parallel for num_threads(threadNum) schedule(static)
+        for (size_t i = 0; i < order.size(); i++) ordered[d][i] = points[d][order[i]];
+    }
+}
+
+void FilteringEngine::build(int node, size_t begin, size_t end, int depth, vector<float> cell) {
+    // `ordered` still holds the points in input order here.
+    float* nodeLower = lower.data() + static_cast<size_t>(node) * dimension;
+    float* nodeUpper = upper.data() + static_cast<size_t>(node) * dimension;
+    double* sums = nodeSums.data() + static_cast<size_t>(node) * dimension;
+
+    if (end - begin <= LEAF_SIZE) {
+        nodes[node] = {-1, -1, begin, end};
+        for (int d = 0; d < dimension; d++) {
+            nodeLower[d] = nodeUpper[d] = ordered[d][order[begin]];
+            double sum = 0;
+            for (size_t i = begin; i < end; i++) {
+                const float coordinate = ordered[d][order[i]];
+                nodeLower[d] = min(nodeLower[d], coordinate);
+                nodeUpper[d] = max(nodeUpper[d], coordinate);
+                sum += coordinate;
+            }
+            sums[d] = sum;
+        }
+        return;
+    }
+
+    // Median split across the widest side of the cell (the box the splits
+    // above leave to this node) keeps the tree balanced, so the node layout
+    // depends only on the point count.
+    int widest = 0;
+    for (int d = 1; d < dimension; d++) {
+        if (cell[dimension + d] - cell[d] > cell[dimension + widest] - cell[widest]) widest = d;
+    }
+    const size_t middle = begin + (end - begin) / 2;
+    const FloatColumn& column = ordered[widest];
+    nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end,
+                [&](size_t a, size_t b) { return column[a] < column[b]; });
+    const int left = node + 1;
+    const int right = left + subtreeNodes(middle - begin);
+    nodes[node] = {left, right, begin, end};
+    vector<float> rightCell = cell;
+    cell[dimension + widest] = rightCell[widest] = column[order[middle]];
+#pragma omp task default(shared) firstprivate(cell) if(depth < TASK_DEPTH)
+    build(left, begin, middle, depth + 1, cell);
+#pragma omp task default(shared) firstprivate(rightCell) if(depth < TASK_DEPTH)
+    build(right, middle, end, depth + 1, rightCell);
+#pragma omp taskwait
+    // The box of the node is the tight one around its points.
+    for (int d = 0; d < dimension; d++) {
+        const size_t leftIndex = static_cast<size_t>(left) * dimension + d;
+        const size_t rightIndex = static_cast<size_t>(right) * dimension + d;
+        nodeLower[d] = min(lower[leftIndex], lower[rightIndex]);
+        nodeUpper[d] = max(upper[leftIndex], upper[rightIndex]);
+        sums[d] = nodeSums[leftIndex] + nodeSums[rightIndex];
+    }
+}
+
+size_t FilteringEngine::memoryBytes() const {
+    return nodes.size() * sizeof(Node) + (lower.size() + upper.size()) * sizeof(float) +
+           nodeSums.size() * sizeof(double) + ordered.size() * dimension * sizeof(float) +
+           order.size() * sizeof(size_t);
+}
+
+size_t FilteringEngine::update(const DataPoints& newCentroids, float* const* sums, int* sizes) {
+    centroids = newCentroids;
+    clusterNum = static_cast<int>(centroids.size());
+    slotSums.assign(static_cast<size_t>(SLOT_NUM) * clusterNum * dimension, 0);
+    slotSizes.assign(static_cast<size_t>(SLOT_NUM) * clusterNum, 0);
+    slotEvaluations.assign(SLOT_NUM, 0);
+    slotCoordinates.resize(static_cast<size_t>(SLOT_NUM) * clusterNum * dimension);
+
+    // A NaN centroid (empty cluster) breaks the pruning test; every point is
+    // then scanned against all the centroids, which is what brute force does.
+    bool finite = true;
+    for (const auto& column : centroids.columns) {
+        for (float value : column) finite = finite && isfinite(value);
+    }
+    if (!nodes.empty() && clusterNum > 0) {
+        vector<int> candidates(clusterNum);
+        iota(candidates.begin(), candidates.end(), 0);
+        vector<int> scratch(static_cast<size_t>(height) * clusterNum);
+        if (finite) {
+            filter(0, candidates.data(), clusterNum, 0, 0, scratch.data());
+        } else {
+            for (const Node& node : nodes) {
+                if (node.left < 0) scanLeaf(node, candidates.data(), clusterNum, 0);
+            }
+        }
+    }
+
+    for (int j = 0; j < clusterNum; j++) {
+        size_t size = 0;
+        for (int slot = 0; slot < SLOT_NUM; slot++) size += slotSizes[static_cast<size_t>(slot) * clusterNum + j];
+        sizes[j] = static_cast<int>(size);
+        for (int d = 0; d < dimension; d++) {
+            double sum = 0;
+            for (int slot = 0; slot < SLOT_NUM; slot++) {
+                sum += slotSums[(static_cast<size_t>(slot) * clusterNum + j) * dimension + d];
+            }
+            sums[d][j] = static_cast<float>(sum);
+        }
+    }
+    return accumulate(slotEvaluations.begin(), slotEvaluations.end(), size_t(0));
+}
+
+void FilteringEngine::filter(int node, const int* candidates, int candidateNum, int depth, int slot, int* scratch) {
+    if (candidateNum == 1) {
+        addNode(node, candidates[0], slot);
+        return;
+    }
+    if (nodes[node].left < 0) {
+        scanLeaf(nodes[node], candidates, candidateNum, slot);
+        return;
+    }
+
+    const float* nodeLower = lower.data() + static_cast<size_t>(node) * dimension;
+    const float* nodeUpper = upper.data() + static_cast<size_t>(node) * dimension;
+    // The candidate closest to the middle of the box...
+    int closest = candidates[0];
+    double closestDistance = HUGE_VAL;
+    for (int c = 0; c < candidateNum; c++) {
+        double distance = 0;
+        for (int d = 0; d < dimension; d++) {
+            double difference = centroids[d][candidates[c]] - (static_cast<double>(nodeLower[d]) + nodeUpper[d]) / 2;
+            distance += difference * difference;
+        }
+        if (distance < closestDistance) {
+            closestDistance = distance;
+            closest = candidates[c];
+        }
+    }
+    // ...rules out every candidate that is farther than it from the whole box,
+    // i.e. from the corner of the box that lies furthest towards the candidate.
+    int* kept = scratch;
+    int keptNum = 0;
+    for (int c = 0; c < candidateNum; c++) {
+        const int candidate = candidates[c];
+        double candidateDistance = 0;
+        double closestCornerDistance = 0;
+        for (int d = 0; d < dimension; d++) {
+            double corner = centroids[d][candidate] > centroids[d][closest] ? nodeUpper[d] : nodeLower[d];
+            double difference = centroids[d][candidate] - corner;
+            candidateDistance += difference * difference;
+            difference = centroids[d][closest] - corner;
+            closestCornerDistance += difference * difference;
+        }
+        if (candidate == closest || candidateDistance <= closestCornerDistance * (1 + BOUND_TOLERANCE)) {
+            kept[keptNum++] = candidate;
+        }
+    }
+    slotEvaluations[slot] += 3 * candidateNum;
+
+    const Node& current = nodes[node];
+    if (depth < TASK_DEPTH) {
+        const int rightSlot = slot + (1 << (TASK_DEPTH - depth - 1));
+        // Tasks need their own copy of the candidates and scratch space.
+        const vector<int> keptCandidates(kept, kept + keptNum);
+#pragma omp task default(shared) firstprivate(keptCandidates)
+        {
+            vector<int> childScratch(static_cast<size_t>(height) * clusterNum);
+            filter(current.left, keptCandidates.data(), keptNum, depth + 1, slot, childScratch.data());
+        }
+#pragma omp task default(shared) firstprivate(keptCandidates)
+        {
+            vector<int> childScratch(static_cast<size_t>(height) * clusterNum);
+            filter(current.right, keptCandidates.data(), keptNum, depth + 1, rightSlot, childScratch.data());
+        }
+#pragma omp taskwait
+    } else {
+        filter(current.left, kept, keptNum, depth + 1, slot, scratch + clusterNum);
+        filter(current.right, kept, keptNum, depth + 1, slot, scratch + clusterNum);
+    }
+}
+
+void FilteringEngine::addNode(int node, int cluster, int slot) {
+    const Node& current = nodes[node];
+    slotSizes[static_cast<size_t>(slot) * clusterNum + cluster] += current.end - current.begin;
+    double* sums = slotSums.data() + (static_cast<size_t>(slot) * clusterNum + cluster) * dimension;
+    for (int d = 0; d < dimension; d++) sums[d] += nodeSums[static_cast<size_t>(node) * dimension + d];
+}
+
+template<int D>
+void FilteringEngine::scanLeaf(const Node& node, const int* candidates, int candidateNum, int slot) {
+    // D == 0 stands for any dimension; small ones are compiled separately.
+    const int dims = D > 0 ? D : dimension;
+    // Only one task at a time works on a slot, so its buffer is free here.
+    float* coordinates = slotCoordinates.data() + static_cast<size_t>(slot) * clusterNum * dimension;
+    for (int c = 0; c < candidateNum; c++) {
+        for (int d = 0; d < dims; d++) coordinates[c * dims + d] = centroids[d][candidates[c]];
+    }
+    size_t* sizes = slotSizes.data() + static_cast<size_t>(slot) * clusterNum;
+    double* sums = slotSums.data() + static_cast<size_t>(slot) * clusterNum * dimension;
+    const float* columns[FILTERING_MAX_DIMENSION];
+    for (int d = 0; d < min(dims, FILTERING_MAX_DIMENSION); d++) columns[d] = ordered[d].data();
+    for (size_t i = node.begin; i < node.end; i++) {
+        // Same distances and tie-breaking as the assignment kernels: candidates
+        // are in index order and only a strictly shorter distance wins.
+        int nearest = 0;
+        float shortestDistance = 0;
+        for (int c = 0; c < candidateNum; c++) {
+            const float* candidate = coordinates + c * dims;
+            float difference = candidate[0] - (D > 0 ? columns[0][i] : ordered[0][i]);
+            float distance = difference * difference;
+            for (int d = 1; d < dims; d++) {
+                difference = candidate[d] - (D > 0 ? columns[d][i] : ordered[d][i]);
+                distance += difference * difference;
+            }
+            if (c == 0 || distance < shortestDistance) {
+                shortestDistance = distance;
+                nearest = c;
+            }
+        }
+        const int cluster = candidates[nearest];
+        sizes[cluster]++;
+        for (int d = 0; d < dims; d++) sums[static_cast<size_t>(cluster) * dims + d] += ordered[d][i];
+    }
+    slotEvaluations[slot] += (node.end - node.begin) * candidateNum;
+}
+
+template<int... D>
+void FilteringEngine::scanLeaf(const Node& node, const int* candidates, int candidateNum, int slot,
+                               integer_sequence<int, D...>) {
+    bool specialized = ((dimension == D + 1 && (scanLeaf<D + 1>(node, candidates, candidateNum, slot), true)) || ...);
+    if (!specialized) scanLeaf<0>(node, candidates, candidateNum, slot);
+}
+
+void FilteringEngine::scanLeaf(const Node& node, const int* candidates, int candidateNum, int slot) {
+    scanLeaf(node, candidates, candidateNum, slot, make_integer_sequence<int, FILTERING_MAX_DIMENSION>());
+}
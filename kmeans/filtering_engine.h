@@ -0,0 +1,73 @@
+#ifndef K_MEANS_FILTERING_ENGINE_H
+#define K_MEANS_FILTERING_ENGINE_H
+
+#include "data_points.h"
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Kanungo et al.'s filtering algorithm. A kd-tree is built once over the
+// points, and every node keeps the bounding box, count and coordinate sums
+// of its points. Each update walks the tree with a shrinking set of candidate
+// centroids: a candidate is dropped from a node when the whole box is closer
+// to another one, and a node left with a single candidate adds its sums to
+// that centroid in one go. Candidates are dropped with a safety margin and
+// leaves are scanned like the brute-force kernels, so every point counts for
+// the centroid the brute-force scan would pick; only the order of the
+// additions differs.
+class FilteringEngine {
+public:
+    // The tree is built with up to threadNum threads.
+    FilteringEngine(const DataPoints& points, int threadNum);
+
+    // Sums of the points nearest to each centroid, sums[d][j] and sizes[j],
+    // and returns how many point-centroid distances were computed. Subtrees
+    // run as OpenMP tasks when called from a parallel region; the result does
+    // not depend on the number of threads.
+    std::size_t update(const DataPoints& centroids, float* const* sums, int* sizes);
+
+    // Bytes taken by the tree and the reordered points.
+    std::size_t memoryBytes() const;
+
+private:
+    struct Node {
+        // A leaf has left == -1 and holds the points [begin, end) of `ordered`.
+        int left;
+        int right;
+        std::size_t begin;
+        std::size_t end;
+    };
+
+    void build(int node, std::size_t begin, std::size_t end, int depth, std::vector<float> cell);
+    void filter(int node, const int* candidates, int candidateNum, int depth, int slot, int* scratch);
+    void addNode(int node, int cluster, int slot);
+    void scanLeaf(const Node& node, const int* candidates, int candidateNum, int slot);
+    template<int D>
+    void scanLeaf(const Node& node, const int* candidates, int candidateNum, int slot);
+    template<int... D>
+    void scanLeaf(const Node& node, const int* candidates, int candidateNum, int slot,
+                  std::integer_sequence<int, D...>);
+
+    int dimension;
+    int height = 0;
+    std::vector<Node> nodes;
+    // Per node: dimension lower corners, upper corners and sums.
+    std::vector<float> lower;
+    std::vector<float> upper;
+    std::vector<double> nodeSums;
+    // The points in leaf order.
+    DataPoints ordered;
+    std::vector<std::size_t> order;
+
+    // Centroids of the current update, and one accumulator per top-level
+    // subtree, merged in subtree order.
+    DataPoints centroids;
+    int clusterNum = 0;
+    std::vector<double> slotSums;
+    std::vector<std::size_t> slotSizes;
+    std::vector<std::size_t> slotEvaluations;
+    // Candidates of the leaf being scanned, gathered point by point.
+    std::vector<float> slotCoordinates;
+};
+
+#endif //K_MEANS_FILTERING_ENGINE_H
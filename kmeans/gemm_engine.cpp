@@ -0,0 +1,312 @@
+#include "gemm_engine.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <immintrin.h>
+
+using namespace std;
+
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+namespace {
+
+// Centroids per panel: the kernel keeps the cross terms of a few vectors of
+// points with one panel in registers.
+const int PANEL_WIDTH = 8;
+// Points whose best and second-best centroids stay in L1 while the centroid
+// tiles go by, and bytes of packed centroids per tile, meant for L2.
+const size_t POINT_TILE = 256;
+const size_t CENTROID_TILE_BYTES = 256 << 10;
+
+// Only the operations the tiles need; see assignment_kernel.cpp.
+struct Scalar {
+    static const int lanes = 1;
+    using Vector = float;
+    using Mask = bool;
+    using Labels = int;
+    static Vector load(const float* values) { return *values; }
+    static void store(float* values, Vector v) { *values = v; }
+    static Vector broadcast(float value) { return value; }
+    static Vector zero() { return 0; }
+    static Vector add(Vector a, Vector b) { return a + b; }
+    static Vector sub(Vector a, Vector b) { return a - b; }
+    static Vector multiplyAdd(Vector a, Vector b, Vector c) { return a * b + c; }
+    static Vector min(Vector a, Vector b) { return a < b ? a : b; }
+    static Mask less(Vector a, Vector b) { return a < b; }
+    static Vector select(Mask mask, Vector a, Vector b) { return mask ? b : a; }
+    static Labels loadLabels(const int* labels) { return *labels; }
+    static Labels selectLabel(Mask mask, Labels labels, int label) { return mask ? label : labels; }
+    static void storeLabels(int* labels, Labels l) { *labels = l; }
+};
+
+struct Avx2 {
+    static const int lanes = 8;
+    using Vector = __m256;
+    using Mask = __m256;
+    using Labels = __m256i;
+    __attribute__((target("avx2,fma"))) static Vector load(const float* values) { return _mm256_loadu_ps(values); }
+    __attribute__((target("avx2,fma"))) static void store(float* values, Vector v) { _mm256_storeu_ps(values, v); }
+    __attribute__((target("avx2,fma"))) static Vector broadcast(float value) { return _mm256_set1_ps(value); }
+    __attribute__((target("avx2,fma"))) static Vector zero() { return _mm256_setzero_ps(); }
+    __attribute__((target("avx2,fma"))) static Vector add(Vector a, Vector b) { return _mm256_add_ps(a, b); }
+    __attribute__((target("avx2,fma"))) static Vector sub(Vector a, Vector b) { return _mm256_sub_ps(a, b); }
+    __attribute__((target("avx2,fma"))) static Vector multiplyAdd(Vector a, Vector b, Vector c) {
+        return _mm256_fmadd_ps(a, b, c);
+    }
+    __attribute__((target("avx2,fma"))) static Vector min(Vector a, Vector b) { return _mm256_min_ps(a, b); }
+    __attribute__((target("avx2,fma"))) static Mask less(Vector a, Vector b) {
+        return _mm256_cmp_ps(a, b, _CMP_LT_OQ);
+    }
+    __attribute__((target("avx2,fma"))) static Vector select(Mask mask, Vector a, Vector b) {
+        return _mm256_blendv_ps(a, b, mask);
+    }
+    __attribute__((target("avx2,fma"))) static Labels loadLabels(const int* labels) {
+        return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(labels));
+    }
+    __attribute__((target("avx2,fma"))) static Labels selectLabel(Mask mask, Labels labels, int label) {
+        return _mm256_blendv_epi8(labels, _mm256_set1_epi32(label), _mm256_castps_si256(mask));
+    }
+    __attribute__((target("avx2,fma"))) static void storeLabels(int* labels, Labels l) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(labels), l);
+    }
+};
+
+struct Avx512 {
+    static const int lanes = 16;
+    using Vector = __m512;
+    using Mask = __mmask16;
+    using Labels = __m512i;
+    __attribute__((target("avx512f"))) static Vector load(const float* values) { return _mm512_loadu_ps(values); }
+    __attribute__((target("avx512f"))) static void store(float* values, Vector v) { _mm512_storeu_ps(values, v); }
+    __attribute__((target("avx512f"))) static Vector broadcast(float value) { return _mm512_set1_ps(value); }
+    __attribute__((target("avx512f"))) static Vector zero() { return _mm512_setzero_ps(); }
+    __attribute__((target("avx512f"))) static Vector add(Vector a, Vector b) { return _mm512_add_ps(a, b); }
+    __attribute__((target("avx512f"))) static Vector sub(Vector a, Vector b) { return _mm512_sub_ps(a, b); }
+    __attribute__((target("avx512f"))) static Vector multiplyAdd(Vector a, Vector b, Vector c) {
+        return _mm512_fmadd_ps(a, b, c);
+    }
+    __attribute__((target("avx512f"))) static Vector min(Vector a, Vector b) { return _mm512_min_ps(a, b); }
+    __attribute__((target("avx512f"))) static Mask less(Vector a, Vector b) {
+        return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ);
+    }
+    __attribute__((target("avx512f"))) static Vector select(Mask mask, Vector a, Vector b) {
+        return _mm512_mask_blend_ps(mask, a, b);
+    }
+    __attribute__((target("avx512f"))) static Labels loadLabels(const int* labels) {
+        return _mm512_loadu_si512(labels);
+    }
+    __attribute__((target("avx512f"))) static Labels selectLabel(Mask mask, Labels labels, int label) {
+        return _mm512_mask_blend_epi32(mask, labels, _mm512_set1_epi32(label));
+    }
+    __attribute__((target("avx512f"))) static void storeLabels(int* labels, Labels l) {
+        _mm512_storeu_si512(labels, l);
+    }
+};
+
+// Microkernel: the cross terms of V vectors of points (starting at `point`,
+// minus the center) with the centroids of one panel, summed over all
+// coordinates in registers. The epilogue turns them into ||c'||² - 2 x'·c'
+// and updates the best and second-best values and the labels of the points.
+// Panels come in label order and only a strictly smaller value wins, so ties
+// keep the lowest label.
+template<typename Isa, int V>
+inline void multiplyPanel(const float* const* columns, size_t point, const float* center, const float* panel,
+                          const float* panelNorms, int dimension, int firstLabel, float* best, float* second,
+                          int* labels) {
+    using Vector = typename Isa::Vector;
+    Vector products[V][PANEL_WIDTH];
+    for (int v = 0; v < V; v++) {
+        for (int n = 0; n < PANEL_WIDTH; n++) products[v][n] = Isa::zero();
+    }
+    for (int d = 0; d < dimension; d++) {
+        Vector coordinates[V];
+        const Vector centerCoordinate = Isa::broadcast(center[d]);
+        for (int v = 0; v < V; v++) {
+            coordinates[v] = Isa::sub(Isa::load(columns[d] + point + v * Isa::lanes), centerCoordinate);
+        }
+        const float* centroidCoordinates = panel + d * PANEL_WIDTH;
+        for (int n = 0; n < PANEL_WIDTH; n++) {
+            const Vector centroidCoordinate = Isa::broadcast(centroidCoordinates[n]);
+            for (int v = 0; v < V; v++) {
+                products[v][n] = Isa::multiplyAdd(coordinates[v], centroidCoordinate, products[v][n]);
+            }
+        }
+    }
+    for (int v = 0; v < V; v++) {
+        const size_t offset = v * Isa::lanes;
+        Vector bestValue = Isa::load(best + offset);
+        Vector secondValue = Isa::load(second + offset);
+        typename Isa::Labels bestLabel = Isa::loadLabels(labels + offset);
+        for (int n = 0; n < PANEL_WIDTH; n++) {
+            const Vector value = Isa::sub(Isa::broadcast(panelNorms[n]), Isa::add(products[v][n], products[v][n]));
+            const auto closer = Isa::less(value, bestValue);
+            secondValue = Isa::select(closer, Isa::min(value, secondValue), bestValue);
+            bestValue = Isa::select(closer, bestValue, value);
+            bestLabel = Isa::selectLabel(closer, bestLabel, firstLabel + n);
+        }
+        Isa::store(best + offset, bestValue);
+        Isa::store(second + offset, secondValue);
+        Isa::storeLabels(labels + offset, bestLabel);
+    }
+}
+
+// Assigns pointNum points from `first` one tile of points at a time; within a
+// tile, the packed centroids are read one L2-sized tile at a time, and each
+// group of points is multiplied by every panel of that tile while it is in L1.
+// Also returns, for every point, how much the gap between its best and
+// second-best value exceeds the rounding error; see GemmEngine::update.
+template<typename Isa, int V>
+inline void assignTiles(const float* const* columns, size_t first, size_t pointNum, const PackedCentroids& centroids,
+                        int* labels, float* slacks) {
+    const int dimension = centroids.dimension;
+    const int panelNum = centroids.panelNum;
+    const int tilePanels = max<int>(1, CENTROID_TILE_BYTES / (sizeof(float) * PANEL_WIDTH * dimension));
+    float best[POINT_TILE];
+    float second[POINT_TILE];
+    float centeredNorms[POINT_TILE];
+    for (size_t tile = 0; tile < pointNum; tile += POINT_TILE) {
+        const size_t tileSize = min(POINT_TILE, pointNum - tile);
+        const size_t tileFirst = first + tile;
+        fill(best, best + tileSize, __builtin_inff());
+        fill(second, second + tileSize, __builtin_inff());
+        fill(labels + tile, labels + tile + tileSize, 0);
+        for (int firstPanel = 0; firstPanel < panelNum; firstPanel += tilePanels) {
+            const int lastPanel = min(panelNum, firstPanel + tilePanels);
+            auto multiplyTile = [&](auto isa, auto vectors, size_t i) {
+                using GroupIsa = decltype(isa);
+                for (int p = firstPanel; p < lastPanel; p++) {
+                    const float* panel = centroids.panels + static_cast<size_t>(p) * PANEL_WIDTH * dimension;
+                    multiplyPanel<GroupIsa, decltype(vectors)::value>(
+                            columns, tileFirst + i, centroids.center, panel, centroids.norms + p * PANEL_WIDTH,
+                            dimension, p * PANEL_WIDTH, best + i, second + i, labels + tile + i);
+                }
+            };
+            size_t i = 0;
+            for (; i + V * Isa::lanes <= tileSize; i += V * Isa::lanes) {
+                multiplyTile(Isa(), integral_constant<int, V>(), i);
+            }
+            for (; i + Isa::lanes <= tileSize; i += Isa::lanes) multiplyTile(Isa(), integral_constant<int, 1>(), i);
+            for (; i < tileSize; i++) multiplyTile(Scalar(), integral_constant<int, 1>(), i);
+        }
+        fill(centeredNorms, centeredNorms + tileSize, 0.f);
+        for (int d = 0; d < dimension; d++) {
+            const float* column = columns[d] + tileFirst;
+            const float center = centroids.center[d];
+            for (size_t i = 0; i < tileSize; i++) {
+                centeredNorms[i] += (column[i] - center) * (column[i] - center);
+            }
+        }
+        const float radius = centroids.radius;
+        for (size_t i = 0; i < tileSize; i++) {
+            const float pointRadius = sqrt(centeredNorms[i]);
+            const float distanceBound = pointRadius + radius;
+            const float scale = 2 * radius * pointRadius + radius * radius + distanceBound * distanceBound;
+            slacks[tile + i] = second[i] - best[i] - centroids.tolerance * scale;
+        }
+    }
+}
+
+// AVX2 has 16 registers: one vector of points keeps the 8 cross terms and
+// the operands in registers; AVX-512 has room for two.
+void assignTilesScalar(const float* const* columns, size_t first, size_t pointNum, const PackedCentroids& centroids,
+                       int* labels, float* slacks) {
+    assignTiles<Scalar, 1>(columns, first, pointNum, centroids, labels, slacks);
+}
+
+__attribute__((target("avx2,fma"), flatten))
+void assignTilesAvx2(const float* const* columns, size_t first, size_t pointNum, const PackedCentroids& centroids,
+                     int* labels, float* slacks) {
+    assignTiles<Avx2, 1>(columns, first, pointNum, centroids, labels, slacks);
+}
+
+__attribute__((target("avx512f"), flatten))
+void assignTilesAvx512(const float* const* columns, size_t first, size_t pointNum, const PackedCentroids& centroids,
+                       int* labels, float* slacks) {
+    assignTiles<Avx512, 2>(columns, first, pointNum, centroids, labels, slacks);
+}
+
+}
+
+void GemmEngine::update(const DataPoints& centroids) {
+    const int dimension = centroids.dimension();
+    const int clusterNum = static_cast<int>(centroids.size());
+    if (!assignTiles || current.dimension() != dimension || current.size() != centroids.size()) {
+        kernel = selectAssignmentKernel(dimension, clusterNum);
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f")) {
+            assignTiles = assignTilesAvx512;
+        } else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+            assignTiles = assignTilesAvx2;
+        } else {
+            assignTiles = assignTilesScalar;
+        }
+    }
+    current = centroids;
+
+    // With m the mean of the centroids, x' = x - m and c' = c - m, the nearest
+    // centroid minimizes ||c'||² - 2 x'·c'. The rounding error then depends on
+    // the distances from m, not from the origin. The centroids of empty
+    // clusters are NaN and are left out, with an infinite norm. The kernel
+    // starts its scan from centroid 0 and a NaN distance never compares
+    // smaller: a NaN centroid 0 takes every point, any other never wins.
+    vector<bool> empty(clusterNum, false);
+    for (int j = 0; j < clusterNum; j++) {
+        for (int d = 0; d < dimension; d++) empty[j] = empty[j] || isnan(centroids[d][j]);
+    }
+    firstEmpty = clusterNum > 0 && empty[0];
+    const int validNum = static_cast<int>(count(empty.begin(), empty.end(), false));
+    center.assign(dimension, 0.f);
+    for (int d = 0; d < dimension; d++) {
+        double sum = 0;
+        for (int j = 0; j < clusterNum; j++) sum += empty[j] ? 0 : centroids[d][j];
+        if (validNum > 0) center[d] = static_cast<float>(sum / validNum);
+    }
+    const int panelNum = (clusterNum + PANEL_WIDTH - 1) / PANEL_WIDTH;
+    panels.assign(static_cast<size_t>(panelNum) * PANEL_WIDTH * dimension, 0.f);
+    norms.assign(static_cast<size_t>(panelNum) * PANEL_WIDTH, __builtin_inff());
+    float radius = 0;
+    for (int j = 0; j < clusterNum; j++) {
+        if (empty[j]) continue;
+        float* panel = panels.data() + static_cast<size_t>(j / PANEL_WIDTH) * PANEL_WIDTH * dimension;
+        float squaredNorm = 0;
+        for (int d = 0; d < dimension; d++) {
+            const float coordinate = centroids[d][j] - center[d];
+            panel[d * PANEL_WIDTH + j % PANEL_WIDTH] = coordinate;
+            squaredNorm += coordinate * coordinate;
+        }
+        norms[j] = squaredNorm;
+        radius = max(radius, sqrt(squaredNorm));
+    }
+
+    // Every term of the values and of the kernel's distances is off by at most
+    // about (D + 2) half ulps of the magnitudes bounded in assignTiles: a gap
+    // below twice the sum of both errors might hide another brute-force winner.
+    packed = {panels.data(), norms.data(), center.data(), dimension, panelNum, radius,
+              2 * (dimension + 2) * FLT_EPSILON};
+}
+
+size_t GemmEngine::assign(const DataPoints& points, size_t begin, size_t end, int* labels) const {
+    const int dimension = current.dimension();
+    const int clusterNum = static_cast<int>(current.size());
+    const vector<const float*> pointColumns = points.columnData();
+    const vector<const float*> centroidColumns = current.columnData();
+    if (firstEmpty) {
+        fill(labels, labels + (end - begin), 0);
+        return 0;
+    }
+    float slacks[ASSIGNMENT_BLOCK_SIZE];
+    size_t rescanned = 0;
+    for (size_t block = begin; block < end; block += ASSIGNMENT_BLOCK_SIZE) {
+        const size_t blockSize = min(ASSIGNMENT_BLOCK_SIZE, end - block);
+        int* blockLabels = labels + (block - begin);
+        assignTiles(pointColumns.data(), block, blockSize, packed, blockLabels, slacks);
+        for (size_t i = 0; i < blockSize; i++) {
+            if (!(slacks[i] > 0)) {
+                kernel.assign(pointColumns.data(), block + i, 1, centroidColumns.data(), dimension, clusterNum,
+                              blockLabels + i);
+                rescanned++;
+            }
+        }
+    }
+    return rescanned;
+}
@@ -0,0 +1,65 @@
+#ifndef K_MEANS_GEMM_ENGINE_H
+#define K_MEANS_GEMM_ENGINE_H
+
+#include "assignment_kernel.h"
+#include "data_points.h"
+#include <cstddef>
+#include <vector>
+
+// Views of GemmEngine's packed centroids, handed to the tile kernels.
+struct PackedCentroids {
+    const float* panels;
+    const float* norms;
+    const float* center;
+    int dimension;
+    int panelNum;
+    // Largest distance of a centroid from the center and relative rounding
+    // error allowed for the near-tie test.
+    float radius;
+    float tolerance;
+};
+
+// Brute-force assignment written as a matrix product, for high dimensions and
+// many clusters. Since ||x - c||² = ||x||² - 2 x·c + ||c||², the nearest
+// centroid minimizes ||c||² - 2 x·c: the cross terms are computed one tile of
+// points by one tile of centroids at a time by a register-blocked kernel, and
+// each tile updates the nearest and second-nearest centroid of its points
+// straight away, so the distance matrix is never stored. Points and centroids
+// are expanded around the mean of the centroids, which keeps the rounding
+// error small for data far from the origin. The expansion still rounds
+// differently from the coordinate differences of the assignment kernel: the
+// points whose two nearest centroids are closer than the rounding error are
+// scanned again by the kernel, so labels are the brute-force ones.
+class GemmEngine {
+public:
+    // Must be called once per iteration, before assign(), with the centroids
+    // the points are going to be assigned to.
+    void update(const DataPoints& centroids);
+
+    // Writes the labels of the points in [begin, end) to labels[0, end - begin)
+    // and returns how many of them were scanned again. Concurrent calls are
+    // fine.
+    std::size_t assign(const DataPoints& points, std::size_t begin, std::size_t end, int* labels) const;
+
+    // Bytes taken by the packed centroids and their norms.
+    std::size_t memoryBytes() const { return (panels.size() + norms.size() + center.size()) * sizeof(float); }
+
+private:
+    using AssignTiles = void (*)(const float* const* columns, std::size_t first, std::size_t pointNum,
+                                 const PackedCentroids& centroids, int* labels, float* slacks);
+
+    AssignmentKernel kernel;
+    AssignTiles assignTiles = nullptr;
+    DataPoints current;
+    // Centroids minus their mean, packed in panels of a few centroids
+    // coordinate after coordinate and padded with zeros; padding centroids
+    // have an infinite norm.
+    std::vector<float> panels;
+    std::vector<float> norms;
+    std::vector<float> center;
+    PackedCentroids packed = {};
+    // Centroid 0 is NaN: every point gets label 0, as in the kernel.
+    bool firstEmpty = false;
+};
+
+#endif //K_MEANS_GEMM_ENGINE_H
@@ -0,0 +1,117 @@
+#include "hamerly_engine.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace {
+
+// Relative margin applied to the bound test, well above the rounding error of
+// the float squared distances used by the brute-force scan.
+const double BOUND_TOLERANCE = 1e-5;
+
+// Summed in coordinate order, like the assignment kernels.
+inline float squaredDistance(const DataPoints& points, size_t i, const DataPoints& centroids, size_t j) {
+    float distance = 0;
+    for (int d = 0; d < points.dimension(); d++) {
+        float difference = centroids[d][j] - points[d][i];
+        distance = d == 0 ? difference * difference : distance + difference * difference;
+    }
+    return distance;
+}
+
+}
+
+HamerlyEngine::HamerlyEngine(size_t pointNum)
+        : pointLabels(pointNum), upper(pointNum), lower(pointNum) {}
+
+void HamerlyEngine::update(const DataPoints& centroids) {
+    const int clusterNum = static_cast<int>(centroids.size());
+    if (current.dimension() != centroids.dimension() || current.size() != centroids.size()) {
+        kernel = selectAssignmentKernel(centroids.dimension(), clusterNum);
+    }
+    // Bounds are only meaningful relative to the previous centroids; an empty
+    // cluster (NaN centroid) forces a full scan to keep brute-force labels.
+    initialized = !current.empty() && current.size() == centroids.size() &&
+                  current.dimension() == centroids.dimension();
+    for (const auto& column : centroids.columns) {
+        for (float value : column) {
+            if (!isfinite(value)) initialized = false;
+        }
+    }
+    shift.assign(clusterNum, 0);
+    maxShift = 0;
+    secondMaxShift = 0;
+    maxShiftCluster = -1;
+    if (initialized) {
+        for (int j = 0; j < clusterNum; j++) {
+            shift[j] = sqrt(static_cast<double>(squaredDistance(current, j, centroids, j)));
+            if (!(shift[j] <= maxShift)) {
+                secondMaxShift = maxShift;
+                maxShift = shift[j];
+                maxShiftCluster = j;
+            } else if (!(shift[j] <= secondMaxShift)) {
+                secondMaxShift = shift[j];
+            }
+        }
+    }
+
+    halfNearestDistance.assign(clusterNum, HUGE_VAL);
+    for (int j = 0; j < clusterNum; j++) {
+        for (int k = j + 1; k < clusterNum; k++) {
+            float squared = squaredDistance(centroids, j, centroids, k);
+            double distance = sqrt(static_cast<double>(squared));
+            halfNearestDistance[j] = min(halfNearestDistance[j], distance / 2);
+            halfNearestDistance[k] = min(halfNearestDistance[k], distance / 2);
+        }
+    }
+    current = centroids;
+}
+
+size_t HamerlyEngine::assign(const DataPoints& points, size_t begin, size_t end) {
+    const int clusterNum = static_cast<int>(current.size());
+    const int dimension = current.dimension();
+    const vector<const float*> centroids = current.columnData();
+    size_t evaluations = 0;
+
+    // Points whose bounds fail are gathered and scanned together by the
+    // vectorized kernel.
+    size_t pending[ASSIGNMENT_BLOCK_SIZE];
+    vector<float> gathered(dimension * ASSIGNMENT_BLOCK_SIZE);
+    vector<const float*> gatheredColumns(dimension);
+    for (int d = 0; d < dimension; d++) gatheredColumns[d] = gathered.data() + d * ASSIGNMENT_BLOCK_SIZE;
+    int labels[ASSIGNMENT_BLOCK_SIZE];
+    float shortestDistances[ASSIGNMENT_BLOCK_SIZE];
+    float secondShortestDistances[ASSIGNMENT_BLOCK_SIZE];
+
+    for (size_t block = begin; block < end; block += ASSIGNMENT_BLOCK_SIZE) {
+        const size_t blockEnd = min(end, block + ASSIGNMENT_BLOCK_SIZE);
+        size_t pendingNum = 0;
+        for (size_t i = block; i < blockEnd; i++) {
+            if (initialized) {
+                const int clusterType = pointLabels[i];
+                upper[i] += shift[clusterType];
+                lower[i] -= clusterType == maxShiftCluster ? secondMaxShift : maxShift;
+                const double bound = max(halfNearestDistance[clusterType], lower[i]) * (1 - BOUND_TOLERANCE);
+                if (upper[i] < bound) continue;
+                upper[i] = sqrt(static_cast<double>(squaredDistance(points, i, current, clusterType)));
+                evaluations++;
+                if (upper[i] < bound) continue;
+            }
+            pending[pendingNum] = i;
+            for (int d = 0; d < dimension; d++) gathered[d * ASSIGNMENT_BLOCK_SIZE + pendingNum] = points[d][i];
+            pendingNum++;
+        }
+
+        kernel.assignWithDistances(gatheredColumns.data(), 0, pendingNum, centroids.data(), dimension, clusterNum,
+                                   labels, shortestDistances, secondShortestDistances);
+        for (size_t p = 0; p < pendingNum; p++) {
+            const size_t i = pending[p];
+            pointLabels[i] = labels[p];
+            upper[i] = sqrt(static_cast<double>(shortestDistances[p]));
+            lower[i] = sqrt(static_cast<double>(secondShortestDistances[p]));
+        }
+        evaluations += pendingNum * clusterNum;
+    }
+    return evaluations;
+}
@@ -0,0 +1,48 @@
+#ifndef K_MEANS_HAMERLY_ENGINE_H
+#define K_MEANS_HAMERLY_ENGINE_H
+
+#include "assignment_kernel.h"
+#include "data_points.h"
+#include <cstddef>
+#include <vector>
+
+// Hamerly's assignment step. Each point keeps an upper bound on the distance
+// to its centroid and a lower bound on the distance to every other centroid;
+// bounds are loosened by the centroid shifts of the last update, and the full
+// scan runs only when they can no longer prove the current assignment.
+// Labels are the ones the brute-force scan would produce: near-ties always
+// fall back to the full scan.
+class HamerlyEngine {
+public:
+    explicit HamerlyEngine(std::size_t pointNum);
+
+    // Must be called once per iteration, before assign(), with the centroids
+    // the points are going to be assigned to. Every point has to be assigned
+    // between two updates.
+    void update(const DataPoints& centroids);
+
+    // Assigns the points in [begin, end) and returns how many point-centroid
+    // distances were computed. Disjoint ranges can run concurrently.
+    std::size_t assign(const DataPoints& points, std::size_t begin, std::size_t end);
+
+    const int* labels() const { return pointLabels.data(); }
+    // Bytes taken by the labels and bounds of the points.
+    std::size_t memoryBytes() const {
+        return pointLabels.size() * sizeof(int) + (upper.size() + lower.size()) * sizeof(double);
+    }
+
+private:
+    AssignmentKernel kernel;
+    std::vector<int> pointLabels;
+    std::vector<double> upper;
+    std::vector<double> lower;
+    DataPoints current;
+    std::vector<double> shift;
+    std::vector<double> halfNearestDistance;
+    double maxShift = 0;
+    double secondMaxShift = 0;
+    int maxShiftCluster = -1;
+    bool initialized = false;
+};
+
+#endif //K_MEANS_HAMERLY_ENGINE_H
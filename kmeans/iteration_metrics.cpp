@@ -0,0 +1,198 @@
+#include "iteration_metrics.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace chrono;
+
+namespace {
+
+struct EventConfig {
+    uint32_t type;
+    uint64_t config;
+};
+
+const EventConfig EVENT_CONFIGS[HARDWARE_EVENT_NUM] = {
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+        {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                             (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)}};
+
+// Counts `event` on the calling thread, on any CPU; -1 on failure.
+int openCounter(HardwareEvent event) {
+    perf_event_attr attributes;
+    memset(&attributes, 0, sizeof(attributes));
+    attributes.size = sizeof(attributes);
+    attributes.type = EVENT_CONFIGS[event].type;
+    attributes.config = EVENT_CONFIGS[event].config;
+    attributes.exclude_kernel = 1;
+    attributes.exclude_hv = 1;
+    return static_cast<int>(syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0));
+}
+
+}
+
+const char* phaseName(Phase phase) {
+    switch (phase) {
+        case ASSIGNMENT_PHASE: return "assignment";
+        case REDUCTION_PHASE: return "reduction";
+        default: return "update";
+    }
+}
+
+const char* hardwareEventName(HardwareEvent event) {
+    switch (event) {
+        case CYCLES: return "cycles";
+        case INSTRUCTIONS: return "instructions";
+        case CACHE_MISSES: return "cache_misses";
+        default: return "llc_misses";
+    }
+}
+
+bool hardwareCountersAvailable() {
+    const int descriptor = openCounter(CYCLES);
+    if (descriptor < 0) return false;
+    close(descriptor);
+    return true;
+}
+
+void IterationMetrics::reset(int maxIterations, int threads) {
+    iterationNum = maxIterations;
+    threadNum = threads;
+    records.assign(static_cast<size_t>(maxIterations) * threads * PHASE_NUM, PhaseMetrics());
+}
+
+void IterationMetrics::finish(int iterations) {
+    iterationNum = iterations;
+    records.resize(static_cast<size_t>(iterations) * threadNum * PHASE_NUM);
+}
+
+double IterationMetrics::slowestThreadMilliseconds(Phase phase) const {
+    double milliseconds = 0;
+    for (int iteration = 0; iteration < iterationNum; iteration++) {
+        double slowest = 0;
+        for (int thread = 0; thread < threadNum; thread++) {
+            slowest = max(slowest, at(iteration, thread, phase).milliseconds);
+        }
+        milliseconds += slowest;
+    }
+    return milliseconds;
+}
+
+bool IterationMetrics::writeJson(const string& path) const {
+    ofstream file(path, ios::trunc);
+    if (!file.is_open()) {
+        cerr << "Error: Unable to open file " << path << endl;
+        return false;
+    }
+    for (int iteration = 0; iteration < iterationNum; iteration++) {
+        file << "{\"iteration\": " << iteration + 1 << ", \"threads\": [";
+        for (int thread = 0; thread < threadNum; thread++) {
+            file << (thread > 0 ? ", " : "") << "{\"thread\": " << thread;
+            for (int phase = 0; phase < PHASE_NUM; phase++) {
+                const PhaseMetrics& metrics = at(iteration, thread, static_cast<Phase>(phase));
+                file << ", \"" << phaseName(static_cast<Phase>(phase)) << "\": {\"ms\": " << metrics.milliseconds;
+                for (int event = 0; event < HARDWARE_EVENT_NUM; event++) {
+                    if (metrics.events[event] < 0) continue;
+                    file << ", \"" << hardwareEventName(static_cast<HardwareEvent>(event)) << "\": "
+                         << metrics.events[event];
+                }
+                file << "}";
+            }
+            file << "}";
+        }
+        file << "]}" << endl;
+    }
+    if (!file) {
+        cerr << "Error: Unable to write file " << path << endl;
+        return false;
+    }
+    return true;
+}
+
+bool IterationMetrics::writeCsv(const string& path) const {
+    ofstream file(path, ios::trunc);
+    if (!file.is_open()) {
+        cerr << "Error: Unable to open file " << path << endl;
+        return false;
+    }
+    file << "iteration,thread";
+    for (int phase = 0; phase < PHASE_NUM; phase++) {
+        const char* name = phaseName(static_cast<Phase>(phase));
+        file << "," << name << "_ms";
+        for (int event = 0; event < HARDWARE_EVENT_NUM; event++) {
+            file << "," << name << "_" << hardwareEventName(static_cast<HardwareEvent>(event));
+        }
+    }
+    file << endl;
+    // Events that were not counted are left empty.
+    for (int iteration = 0; iteration < iterationNum; iteration++) {
+        for (int thread = 0; thread < threadNum; thread++) {
+            file << iteration + 1 << "," << thread;
+            for (int phase = 0; phase < PHASE_NUM; phase++) {
+                const PhaseMetrics& metrics = at(iteration, thread, static_cast<Phase>(phase));
+                file << "," << metrics.milliseconds;
+                for (long long count : metrics.events) {
+                    file << ",";
+                    if (count >= 0) file << count;
+                }
+            }
+            file << endl;
+        }
+    }
+    if (!file) {
+        cerr << "Error: Unable to write file " << path << endl;
+        return false;
+    }
+    return true;
+}
+
+PhaseTimer::PhaseTimer(IterationMetrics* metrics) : metrics(metrics) {
+    for (int event = 0; event < HARDWARE_EVENT_NUM; event++) {
+        const bool counted = metrics && metrics->countsHardwareEvents();
+        descriptors[event] = counted ? openCounter(static_cast<HardwareEvent>(event)) : -1;
+    }
+    restart();
+}
+
+PhaseTimer::~PhaseTimer() {
+    for (int descriptor : descriptors) {
+        if (descriptor >= 0) close(descriptor);
+    }
+}
+
+void PhaseTimer::readEvents(long long* values) const {
+    for (int event = 0; event < HARDWARE_EVENT_NUM; event++) {
+        uint64_t count;
+        const bool counted = descriptors[event] >= 0 && read(descriptors[event], &count, sizeof(count)) == sizeof(count);
+        values[event] = counted ? static_cast<long long>(count) : -1;
+    }
+}
+
+void PhaseTimer::restart() {
+    if (!metrics) return;
+    readEvents(startEvents);
+    start = steady_clock::now();
+}
+
+void PhaseTimer::stop(int iteration, int thread, Phase phase) {
+    if (!metrics) return;
+    const auto end = steady_clock::now();
+    long long endEvents[HARDWARE_EVENT_NUM];
+    readEvents(endEvents);
+    PhaseMetrics& record = metrics->at(iteration, thread, phase);
+    record.milliseconds += duration_cast<nanoseconds>(end - start).count() / 1e6;
+    for (int event = 0; event < HARDWARE_EVENT_NUM; event++) {
+        if (endEvents[event] < 0 || startEvents[event] < 0) continue;
+        record.events[event] = max(record.events[event], 0LL) + endEvents[event] - startEvents[event];
+    }
+    for (int event = 0; event < HARDWARE_EVENT_NUM; event++) startEvents[event] = endEvents[event];
+    start = end;
+}
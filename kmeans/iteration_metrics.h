@@ -0,0 +1,95 @@
+#ifndef K_MEANS_ITERATION_METRICS_H
+#define K_MEANS_ITERATION_METRICS_H
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Phases of a Lloyd iteration: the assignment of the points together with
+// the per-thread cluster sums, the merge of those sums (and their exchange
+// between the processes of a distributed run), and the new centroids with the
+// convergence check. A thread waiting for the others at the end of a phase
+// counts the wait in that phase.
+enum Phase { ASSIGNMENT_PHASE, REDUCTION_PHASE, UPDATE_PHASE, PHASE_NUM };
+
+// Hardware events counted in user space through perf_event_open. CACHE_MISSES
+// is the generic event of the CPU (usually last level references that miss),
+// LLC_MISSES the last level cache read misses.
+enum HardwareEvent { CYCLES, INSTRUCTIONS, CACHE_MISSES, LLC_MISSES, HARDWARE_EVENT_NUM };
+
+const char* phaseName(Phase phase);
+const char* hardwareEventName(HardwareEvent event);
+
+// Whether this process may count CPU cycles; without the permission
+// (kernel.perf_event_paranoid) or a PMU, as in most virtual machines, only
+// the phase times are measured.
+bool hardwareCountersAvailable();
+
+struct PhaseMetrics {
+    double milliseconds = 0;
+    // -1 for the events that were not counted.
+    long long events[HARDWARE_EVENT_NUM] = {-1, -1, -1, -1};
+};
+
+// Phase metrics of every iteration and thread of the last run they were
+// passed to (LloydOptions::metrics). Console output is never part of a phase.
+class IterationMetrics {
+public:
+    explicit IterationMetrics(bool countHardwareEvents = false) : hardwareEvents(countHardwareEvents) {}
+
+    bool countsHardwareEvents() const { return hardwareEvents; }
+    int iterations() const { return iterationNum; }
+    int threads() const { return threadNum; }
+    PhaseMetrics& at(int iteration, int thread, Phase phase) {
+        return records[(static_cast<std::size_t>(iteration) * threadNum + thread) * PHASE_NUM + phase];
+    }
+    const PhaseMetrics& at(int iteration, int thread, Phase phase) const {
+        return records[(static_cast<std::size_t>(iteration) * threadNum + thread) * PHASE_NUM + phase];
+    }
+
+    // Called by the k-means functions before the iterations: room for up to
+    // maxIterations, so that every thread fills its own records unlocked.
+    void reset(int maxIterations, int threads);
+    // Called after the iterations, `iterations` of which ran.
+    void finish(int iterations);
+
+    // Sum over the iterations of the slowest thread's time in `phase`.
+    double slowestThreadMilliseconds(Phase phase) const;
+
+    // One record per iteration holding the phases of every thread.
+    bool writeJson(const std::string& path) const;
+    // One row per iteration and thread.
+    bool writeCsv(const std::string& path) const;
+
+private:
+    bool hardwareEvents;
+    int iterationNum = 0;
+    int threadNum = 0;
+    std::vector<PhaseMetrics> records;
+};
+
+// Times consecutive phases on the thread that creates it: each stop() covers
+// what happened since the previous stop() or restart(). Does nothing when
+// `metrics` is null.
+class PhaseTimer {
+public:
+    explicit PhaseTimer(IterationMetrics* metrics);
+    ~PhaseTimer();
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+    void restart();
+    void stop(int iteration, int thread, Phase phase);
+
+private:
+    void readEvents(long long* values) const;
+
+    IterationMetrics* metrics;
+    // Counters of the creating thread, -1 where unavailable.
+    int descriptors[HARDWARE_EVENT_NUM];
+    std::chrono::steady_clock::time_point start;
+    long long startEvents[HARDWARE_EVENT_NUM];
+};
+
+#endif //K_MEANS_ITERATION_METRICS_H
@@ -0,0 +1,178 @@
+#include "kmeans_model.h"
+#include "assignment_kernel.h"
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <utility>
+
+using namespace std;
+
+namespace {
+
+// Columns that point into the caller's buffers; nothing is copied.
+DataPoints borrowColumns(const PointsView& points) {
+    DataPoints columns(points.dimension);
+    shared_ptr<void> caller(const_cast<float*>(points.columns.front()), [](void*) {});
+    for (int d = 0; d < points.dimension; d++) {
+        columns[d].adopt(const_cast<float*>(points.columns[d]), points.size, caller);
+    }
+    return columns;
+}
+
+DataPoints splitColumns(const PointsView& points) {
+    DataPoints columns(points.dimension);
+    columns.resize(points.size);
+#pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < points.size; i++) {
+        for (int d = 0; d < points.dimension; d++) columns[d][i] = points.interleaved[i * points.dimension + d];
+    }
+    return columns;
+}
+
+vector<float> interleavePoints(const PointsView& points) {
+    vector<float> interleaved(points.size * points.dimension);
+#pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < points.size; i++) {
+        for (int d = 0; d < points.dimension; d++) interleaved[i * points.dimension + d] = points.columns[d][i];
+    }
+    return interleaved;
+}
+
+bool fitSequentialAoS(const PointsView& points, DataPoints& centroids, const LloydOptions& options, KMeansRun& run) {
+    if (points.dimension > MAX_AOS_DIMENSION) {
+        cerr << "Error: at most " << MAX_AOS_DIMENSION << " coordinates are supported" << endl;
+        return false;
+    }
+    run = kMeansSequentialAoS(points.interleaved, points.size, centroids, options);
+    return true;
+}
+
+bool fitSequentialSoA(const PointsView& points, DataPoints& centroids, const LloydOptions& options, KMeansRun& run) {
+    run = kMeansSequentialSoA(borrowColumns(points), centroids, options);
+    return true;
+}
+
+bool fitOpenMP(const PointsView& points, DataPoints& centroids, const LloydOptions& options, KMeansRun& run) {
+    run = kMeansParallel(borrowColumns(points), centroids, options);
+    return true;
+}
+
+bool fitWorkerPool(const PointsView& points, DataPoints& centroids, const LloydOptions& options, KMeansRun& run) {
+    if (options.engine == AssignmentEngine::Filtering) {
+        cerr << "Error: the filtering engine cannot run on the worker pool" << endl;
+        return false;
+    }
+    run = kMeansPooled(borrowColumns(points), centroids, options, defaultWorkerPool());
+    return true;
+}
+
+}
+
+PointsView PointsView::fromColumns(const float* const* columns, int dimension, size_t size) {
+    PointsView view;
+    view.size = size;
+    view.dimension = dimension;
+    view.columns.assign(columns, columns + dimension);
+    return view;
+}
+
+PointsView PointsView::fromInterleaved(const float* points, int dimension, size_t size) {
+    PointsView view;
+    view.size = size;
+    view.dimension = dimension;
+    view.interleaved = points;
+    return view;
+}
+
+PointsView PointsView::fromDataPoints(const DataPoints& points) {
+    return fromColumns(points.columnData().data(), points.dimension(), points.size());
+}
+
+ExecutionBackend sequentialAoSBackend() {
+    return {"sequential AoS", true, fitSequentialAoS};
+}
+
+ExecutionBackend sequentialSoABackend() {
+    return {"sequential SoA", false, fitSequentialSoA};
+}
+
+ExecutionBackend openMPBackend() {
+    return {"OpenMP", false, fitOpenMP};
+}
+
+ExecutionBackend workerPoolBackend() {
+    return {"worker pool", false, fitWorkerPool};
+}
+
+KMeansModel::KMeansModel(ExecutionBackend backend, LloydOptions options)
+        : executionBackend(move(backend)), lloydOptions(options) {}
+
+bool KMeansModel::fit(const PointsView& points, const DataPoints& initialCentroids, KMeansRun& run) {
+    if (points.dimension <= 0 || initialCentroids.dimension() != points.dimension || initialCentroids.empty()) {
+        cerr << "Error: the centroids have " << initialCentroids.dimension() << " coordinates, the points have "
+             << points.dimension << endl;
+        return false;
+    }
+    DataPoints centroids = initialCentroids;
+    bool fitted;
+    if (executionBackend.interleaved == points.isInterleaved()) {
+        fitted = executionBackend.fit(points, centroids, lloydOptions, run);
+    } else if (executionBackend.interleaved) {
+        vector<float> interleaved = interleavePoints(points);
+        PointsView view = PointsView::fromInterleaved(interleaved.data(), points.dimension, points.size);
+        fitted = executionBackend.fit(view, centroids, lloydOptions, run);
+    } else {
+        DataPoints columns = splitColumns(points);
+        fitted = executionBackend.fit(PointsView::fromDataPoints(columns), centroids, lloydOptions, run);
+    }
+    if (!fitted) return false;
+    setCentroids(move(centroids));
+    return true;
+}
+
+void KMeansModel::setCentroids(DataPoints centroids) {
+    modelCentroids = move(centroids);
+    centroidIndex = CentroidIndex::suits(modelCentroids) ? CentroidIndex(modelCentroids) : CentroidIndex();
+}
+
+bool KMeansModel::predict(const PointsView& points, int* labels) const {
+    if (modelCentroids.empty() || points.dimension != dimension()) {
+        cerr << "Error: the points have " << points.dimension << " coordinates, the model has " << dimension() << endl;
+        return false;
+    }
+    const int dimension = points.dimension;
+    const int clusterNum = this->clusterNum();
+    const AssignmentKernel kernel = selectAssignmentKernel(dimension, clusterNum);
+    const vector<const float*> centroidColumns = modelCentroids.columnData();
+    const long blockNum = static_cast<long>((points.size + ASSIGNMENT_BLOCK_SIZE - 1) / ASSIGNMENT_BLOCK_SIZE);
+
+#pragma omp parallel num_threads(lloydOptions.threadNum)
+    {
+        // Interleaved points are gathered one block at a time into columns.
+        vector<float> gathered(points.isInterleaved() ? dimension * ASSIGNMENT_BLOCK_SIZE : 0);
+        vector<const float*> gatheredColumns(dimension);
+        for (int d = 0; d < dimension && points.isInterleaved(); d++) {
+            gatheredColumns[d] = gathered.data() + d * ASSIGNMENT_BLOCK_SIZE;
+        }
+#pragma omp for schedule(static)
+        for (long block = 0; block < blockNum; block++) {
+            const size_t first = block * ASSIGNMENT_BLOCK_SIZE;
+            const size_t blockSize = min(ASSIGNMENT_BLOCK_SIZE, points.size - first);
+            if (points.isInterleaved()) {
+                for (size_t i = 0; i < blockSize; i++) {
+                    for (int d = 0; d < dimension; d++) {
+                        gathered[d * ASSIGNMENT_BLOCK_SIZE + i] = points.interleaved[(first + i) * dimension + d];
+                    }
+                }
+            }
+            const float* const* columns = points.isInterleaved() ? gatheredColumns.data() : points.columns.data();
+            const size_t offset = points.isInterleaved() ? 0 : first;
+            if (!centroidIndex.empty()) {
+                centroidIndex.assign(columns, offset, blockSize, labels + first);
+            } else {
+                kernel.assign(columns, offset, blockSize, centroidColumns.data(), dimension, clusterNum, labels + first);
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,75 @@
+#ifndef K_MEANS_KMEANS_MODEL_H
+#define K_MEANS_KMEANS_MODEL_H
+
+#include "centroid_index.h"
+#include "data_points.h"
+#include "lloyd.h"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Points owned by the caller, stored either column by column (SoA) or
+// interleaved, `dimension` floats per point (AoS). The buffers must outlive
+// the calls that receive the view.
+struct PointsView {
+    std::size_t size = 0;
+    int dimension = 0;
+    std::vector<const float*> columns;
+    const float* interleaved = nullptr;
+
+    static PointsView fromColumns(const float* const* columns, int dimension, std::size_t size);
+    static PointsView fromInterleaved(const float* points, int dimension, std::size_t size);
+    static PointsView fromDataPoints(const DataPoints& points);
+
+    bool isInterleaved() const { return interleaved != nullptr; }
+};
+
+// Runs the Lloyd iterations for one memory layout. The model hands `fit`
+// points in the backend's layout: a view in that layout is used in place,
+// one in the other layout is converted once per fit, outside the timed
+// iterations. fit returns false if the backend cannot handle the points.
+struct ExecutionBackend {
+    std::string name;
+    bool interleaved;
+    bool (*fit)(const PointsView& points, DataPoints& centroids, const LloydOptions& options, KMeansRun& run);
+};
+
+ExecutionBackend sequentialAoSBackend();
+ExecutionBackend sequentialSoABackend();
+// Uses options.threadNum threads.
+ExecutionBackend openMPBackend();
+// Uses options.threadNum workers of defaultWorkerPool() (see kMeansPooled).
+ExecutionBackend workerPoolBackend();
+
+// Centroids plus the way to train them. fit() replaces the centroids with
+// the ones it converges to; predict() assigns points to the current ones.
+class KMeansModel {
+public:
+    explicit KMeansModel(ExecutionBackend backend = sequentialSoABackend(), LloydOptions options = LloydOptions());
+
+    const ExecutionBackend& backend() const { return executionBackend; }
+    LloydOptions& options() { return lloydOptions; }
+    const LloydOptions& options() const { return lloydOptions; }
+    const DataPoints& centroids() const { return modelCentroids; }
+    // E.g. centroids saved by an earlier fit (see centroid_config.h).
+    void setCentroids(DataPoints centroids);
+    int clusterNum() const { return static_cast<int>(modelCentroids.size()); }
+    int dimension() const { return modelCentroids.dimension(); }
+
+    // Trains from `initialCentroids`, which must have the dimension of the
+    // points. On failure the model is left untouched.
+    bool fit(const PointsView& points, const DataPoints& initialCentroids, KMeansRun& run);
+
+    // Writes the index of the nearest centroid of every point to `labels`.
+    // With many low-dimensional centroids the search goes through a kd-tree
+    // over the centroids instead of scanning all of them.
+    bool predict(const PointsView& points, int* labels) const;
+
+private:
+    ExecutionBackend executionBackend;
+    LloydOptions lloydOptions;
+    DataPoints modelCentroids;
+    CentroidIndex centroidIndex;
+};
+
+#endif //K_MEANS_KMEANS_MODEL_H
@@ -0,0 +1,939 @@
+#include "lloyd.h"
+#include "assignment_kernel.h"
+#include "centroid_config.h"
+#include "cluster_accumulators.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <omp.h>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+using namespace std;
+using namespace chrono;
+
+namespace {
+
+// Chunks of blocks per worker of kMeansPooled: enough for stealing to even
+// out the workers, few enough that merging their sums stays cheap.
+const int POOL_CHUNKS_PER_WORKER = 4;
+
+template<int D>
+struct DataPoint {
+    float coordinates[D];
+
+    DataPoint() : coordinates() {}
+};
+
+template<int D>
+void printCentroids(vector<DataPoint<D>>& centroids) {
+    for (const auto& element : centroids) {
+        cout << "(";
+        for (int d = 0; d < D; d++) cout << (d > 0 ? ", " : "") << element.coordinates[d];
+        cout << ")" << endl;
+    }
+}
+
+template<int D>
+void interleave(const DataPoints& columns, vector<DataPoint<D>>& points) {
+    size_t firstPoint = points.size();
+    points.resize(firstPoint + columns.size());
+#pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < columns.size(); i++) {
+        for (int d = 0; d < D; d++) points[firstPoint + i].coordinates[d] = columns[d][i];
+    }
+}
+
+template<int D>
+KMeansRun kMeansAoS(const float* interleavedPoints, size_t pointNum, DataPoints& resultCentroids,
+                    const LloydOptions& options) {
+    // DataPoint<D> is D packed floats, so the caller's buffer is used in place.
+    static_assert(sizeof(DataPoint<D>) == D * sizeof(float), "DataPoint must not be padded");
+    const auto* points = reinterpret_cast<const DataPoint<D>*>(interleavedPoints);
+    vector<DataPoint<D>> centroids;
+    interleave(resultCentroids, centroids);
+    const int clusterNum = static_cast<int>(centroids.size());
+
+    vector<int> pointLabels(options.stopOnConvergence ? pointNum : 0, -1);
+    KMeansRun run;
+
+    auto printing = high_resolution_clock::duration::zero();
+    auto startTime = high_resolution_clock::now();
+    for (int iteration=0; iteration<options.iterationNum && !run.converged; iteration++) {
+        vector<DataPoint<D>> newCentroids(clusterNum);
+        vector<int> clustersSize(clusterNum);
+        for (int i=0; i < clusterNum; i++){
+            DataPoint<D> datapoint;
+            newCentroids.emplace_back(datapoint);
+        }
+
+        size_t changedPoints = 0;
+        for (size_t i=0; i < pointNum; i++) {
+            double squaredDistance = 0;
+            for (int d = 0; d < D; d++) squaredDistance += pow(centroids[0].coordinates[d] - points[i].coordinates[d], 2);
+            float shortestDistance = sqrt(squaredDistance);
+            int clusterType = 0;
+            for (int j=1; j<centroids.size(); j++) {
+                squaredDistance = 0;
+                for (int d = 0; d < D; d++) squaredDistance += pow(centroids[j].coordinates[d] - points[i].coordinates[d], 2);
+                float centroidDistance = sqrt(squaredDistance);
+                if (centroidDistance < shortestDistance) {
+                    shortestDistance = centroidDistance;
+                    clusterType = j;
+                }
+            }
+            for (int d = 0; d < D; d++) newCentroids[clusterType].coordinates[d] += points[i].coordinates[d];
+            clustersSize[clusterType]++;
+            if (options.stopOnConvergence) {
+                changedPoints += pointLabels[i] != clusterType;
+                pointLabels[i] = clusterType;
+            }
+        }
+
+        float maxShift = 0;
+        for (int i=0; i<centroids.size(); i++) {
+            DataPoint<D> centroid;
+            float squaredShift = 0;
+            for (int d = 0; d < D; d++) {
+                centroid.coordinates[d] = newCentroids[i].coordinates[d] / clustersSize[i];
+                float difference = centroid.coordinates[d] - centroids[i].coordinates[d];
+                squaredShift += difference * difference;
+            }
+            maxShift = max(maxShift, sqrt(squaredShift));
+            centroids[i] = centroid;
+        }
+        run.iterations++;
+        run.converged = options.stopOnConvergence && (changedPoints == 0 || maxShift <= options.convergenceTolerance);
+
+        if (options.verbose) {
+            auto printStart = high_resolution_clock::now();
+            cout << endl << "Iteration " << options.firstIterationNumber + iteration << ":" << endl << endl;
+            for (int i=0; i < clusterNum; i++) {
+                cout << "Cluster" << i+1 << " size: " << clustersSize[i] << endl;
+            }
+            if (options.stopOnConvergence) {
+                cout << "Points changed cluster: " << changedPoints << ", max centroid shift: " << maxShift << endl;
+            }
+            cout << endl;
+            printCentroids(centroids);
+            printing += high_resolution_clock::now() - printStart;
+        }
+    }
+    auto endTime = high_resolution_clock::now();
+    run.duration = duration_cast<microseconds>(endTime - startTime - printing).count() / 1000.f;
+
+    for (int i = 0; i < clusterNum; i++) {
+        for (int d = 0; d < D; d++) resultCentroids[d][i] = centroids[i].coordinates[d];
+    }
+    return run;
+}
+
+template<int... D>
+KMeansRun kMeansAoS(const float* points, size_t pointNum, DataPoints& centroids, const LloydOptions& options,
+                    integer_sequence<int, D...>) {
+    KMeansRun run;
+    bool supported = ((centroids.dimension() == D + 1 &&
+                       (run = kMeansAoS<D + 1>(points, pointNum, centroids, options), true)) || ...);
+    if (!supported) cerr << "Error: at most " << MAX_AOS_DIMENSION << " coordinates are supported" << endl;
+    return run;
+}
+
+// The versions below share one iteration loop, lloydIterations(), put
+// together from:
+// - a point source, which hands out the coordinates of a block of points;
+// - the cluster sums (the sink), which add up the blocks of every part of the
+//   rows and merge the parts in part order, so that the result depends on
+//   the number of parts but not on the thread running each of them;
+// - a schedule, which splits the rows into parts and the parts among the
+//   threads, and a team running those threads;
+// - an exchange hook, which shares the sums of the parts with the other
+//   shards between the assignment and the merge.
+
+// Counted during an iteration and added up over the threads and the shards.
+struct IterationCounters {
+    size_t distanceEvaluations = 0;
+    size_t rescannedPoints = 0;
+    size_t changedPoints = 0;
+
+    void add(const IterationCounters& other) {
+        distanceEvaluations += other.distanceEvaluations;
+        rescannedPoints += other.rescannedPoints;
+        changedPoints += other.changedPoints;
+    }
+};
+
+// Points read in place from their float columns; the only source the
+// engines take.
+class FloatSource {
+public:
+    explicit FloatSource(const DataPoints& points) : points(points), columns(points.columnData()) {}
+
+    const DataPoints& dataPoints() const { return points; }
+    size_t size() const { return points.size(); }
+    int dimension() const { return points.dimension(); }
+
+    struct Buffer {
+        explicit Buffer(int) {}
+    };
+
+    // Columns holding points [first, first + count), from index `offset` on.
+    const float* const* block(size_t first, size_t, Buffer&, size_t& offset) const {
+        offset = first;
+        return columns.data();
+    }
+
+private:
+    const DataPoints& points;
+    const vector<const float*> columns;
+};
+
+// 16-bit points, decoded block by block: the decoded block stays in cache
+// between the assignment and the sums.
+class CompactSource {
+public:
+    explicit CompactSource(const CompactPoints& points) : points(points) {}
+
+    size_t size() const { return points.size(); }
+    int dimension() const { return points.dimension(); }
+
+    struct Buffer {
+        explicit Buffer(int dimension)
+                : values(static_cast<size_t>(dimension) * ASSIGNMENT_BLOCK_SIZE), columns(dimension) {
+            for (int d = 0; d < dimension; d++) columns[d] = values.data() + d * ASSIGNMENT_BLOCK_SIZE;
+        }
+
+        vector<float> values;
+        vector<const float*> columns;
+    };
+
+    const float* const* block(size_t first, size_t count, Buffer& buffer, size_t& offset) const {
+        for (int d = 0; d < points.dimension(); d++) {
+            points.decode(d, first, count, buffer.values.data() + d * ASSIGNMENT_BLOCK_SIZE);
+        }
+        offset = 0;
+        return buffer.columns.data();
+    }
+
+private:
+    const CompactPoints& points;
+};
+
+struct NoWeights {
+    static constexpr bool weighted = false;
+};
+
+struct PointWeights {
+    static constexpr bool weighted = true;
+    const float* values;
+};
+
+// Float sums of every part in ClusterAccumulators, merged in float. The
+// shards exchange the accumulators as they are, and the filtering engine
+// writes the totals directly.
+class FloatSums {
+public:
+    FloatSums(int partNum, int dimension, int clusterNum)
+            : accumulators(partNum, dimension, clusterNum), totals(dimension), totalSizes(clusterNum),
+              totalColumns(dimension) {
+        totals.resize(clusterNum);
+        for (int d = 0; d < dimension; d++) totalColumns[d] = totals[d].data();
+    }
+
+    struct Buffer {
+        explicit Buffer(int dimension) : sums(dimension), merged(dimension) {}
+
+        vector<float*> sums;
+        vector<float> merged;
+    };
+
+    void clear(int part) { accumulators.clear(part); }
+
+    void add(int part, const float* const* columns, size_t offset, size_t, size_t count, const int* labels,
+             const AssignmentKernel& kernel, Buffer& buffer) {
+        const int dimension = totals.dimension();
+        for (int d = 0; d < dimension; d++) buffer.sums[d] = accumulators.sums(part, d);
+        kernel.accumulate(columns, offset, count, labels, dimension, buffer.sums.data(), accumulators.sizes(part));
+    }
+
+    void merge(int i, Buffer& buffer) {
+        accumulators.merge(i, buffer.merged.data(), totalSizes[i]);
+        for (int d = 0; d < totals.dimension(); d++) totals[d][i] = buffer.merged[d];
+    }
+
+    float sum(int i, int d) const { return totals[d][i]; }
+    int size(int i) const { return totalSizes[i]; }
+    bool keepsEmptyClusters() const { return false; }
+    void printSize(int i) const { cout << " size: " << totalSizes[i]; }
+
+    ClusterAccumulators& parts() { return accumulators; }
+    float* const* totalSumColumns() { return totalColumns.data(); }
+    int* totalSizeData() { return totalSizes.data(); }
+
+private:
+    ClusterAccumulators accumulators;
+    DataPoints totals;
+    vector<int> totalSizes;
+    vector<float*> totalColumns;
+};
+
+// Double sums of every part, with every point added on its own. A warm start
+// adds the sums of the points it has already seen (`base`), and clusters
+// without points then keep their centroid. Weighted points add their
+// weight to the size of their cluster instead of one.
+template<typename Weights>
+class DoubleSums {
+public:
+    using Size = conditional_t<Weights::weighted, double, size_t>;
+
+    DoubleSums(int partNum, int dimension, int clusterNum, Weights weights, bool keepEmpty,
+               const double* baseSums = nullptr, const uint64_t* baseSizes = nullptr)
+            : partNum(partNum), dimension(dimension), clusterNum(clusterNum), weights(weights), keepEmpty(keepEmpty),
+              baseSums(baseSums), baseSizes(baseSizes),
+              partSums(static_cast<size_t>(partNum) * clusterNum * dimension),
+              partSizes(static_cast<size_t>(partNum) * clusterNum),
+              totals(static_cast<size_t>(clusterNum) * dimension), totalSizes(clusterNum) {}
+
+    struct Buffer {
+        explicit Buffer(int) {}
+    };
+
+    void clear(int part) {
+        double* sums = partSums.data() + static_cast<size_t>(part) * clusterNum * dimension;
+        fill(sums, sums + static_cast<size_t>(clusterNum) * dimension, 0.0);
+        fill(partSizes.begin() + static_cast<size_t>(part) * clusterNum,
+             partSizes.begin() + static_cast<size_t>(part + 1) * clusterNum, Size(0));
+    }
+
+    void add(int part, const float* const* columns, size_t offset, size_t firstRow, size_t count, const int* labels,
+             const AssignmentKernel& kernel, Buffer&) {
+        double* sums = partSums.data() + static_cast<size_t>(part) * clusterNum * dimension;
+        Size* sizes = partSizes.data() + static_cast<size_t>(part) * clusterNum;
+        if constexpr (Weights::weighted) {
+            for (size_t i = 0; i < count; i++) {
+                const double weight = weights.values[firstRow + i];
+                double* sum = sums + static_cast<size_t>(labels[i]) * dimension;
+                sizes[labels[i]] += weight;
+                for (int d = 0; d < dimension; d++) sum[d] += weight * columns[d][offset + i];
+            }
+        } else {
+            kernel.accumulateDouble(columns, offset, count, labels, dimension, sums, sizes);
+        }
+    }
+
+    void merge(int i, Buffer&) {
+        double* sum = totals.data() + static_cast<size_t>(i) * dimension;
+        fill(sum, sum + dimension, 0.0);
+        totalSizes[i] = 0;
+        for (size_t part = 0; part < static_cast<size_t>(partNum); part++) {
+            totalSizes[i] += partSizes[part * clusterNum + i];
+            for (int d = 0; d < dimension; d++) sum[d] += partSums[(part * clusterNum + i) * dimension + d];
+        }
+    }
+
+    double sum(int i, int d) const {
+        const size_t index = static_cast<size_t>(i) * dimension + d;
+        return baseSums ? baseSums[index] + totals[index] : totals[index];
+    }
+
+    double size(int i) const {
+        if constexpr (Weights::weighted) {
+            return totalSizes[i];
+        } else {
+            return static_cast<double>(baseSizes ? baseSizes[i] + totalSizes[i] : totalSizes[i]);
+        }
+    }
+
+    bool keepsEmptyClusters() const { return keepEmpty; }
+
+    void printSize(int i) const {
+        if constexpr (Weights::weighted) {
+            cout << " weight: " << totalSizes[i];
+        } else if (baseSizes) {
+            cout << " size: " << baseSizes[i] + totalSizes[i] << " (" << totalSizes[i] << " new)";
+        } else {
+            cout << " size: " << totalSizes[i];
+        }
+    }
+
+    // Sums and sizes of the last assignment alone, without the base.
+    const vector<double>& pointSums() const { return totals; }
+    const vector<Size>& pointSizes() const { return totalSizes; }
+
+private:
+    const int partNum;
+    const int dimension;
+    const int clusterNum;
+    const Weights weights;
+    const bool keepEmpty;
+    const double* baseSums;
+    const uint64_t* baseSizes;
+    vector<double> partSums;
+    vector<Size> partSizes;
+    vector<double> totals;
+    vector<Size> totalSizes;
+};
+
+// Only the engine in use holds per-point state.
+size_t engineMemory(const HamerlyEngine& hamerly, const YinyangEngine& yinyang, const FilteringEngine& filtering,
+                    const GemmEngine& gemm) {
+    return hamerly.memoryBytes() + yinyang.memoryBytes() + filtering.memoryBytes() + gemm.memoryBytes();
+}
+
+// The assignment engine of a run over float points; brute force runs the
+// kernel.
+class Engines {
+public:
+    Engines(AssignmentEngine engine, const DataPoints& points, int threadNum)
+            : engine(engine), noPoints(points.dimension()),
+              hamerly(engine == AssignmentEngine::Hamerly ? points.size() : 0),
+              yinyang(engine == AssignmentEngine::Yinyang ? points.size() : 0),
+              filtering(engine == AssignmentEngine::Filtering ? points : noPoints, threadNum) {}
+
+    bool is(AssignmentEngine other) const { return engine == other; }
+    bool needsUpdate() const { return engine != AssignmentEngine::BruteForce; }
+    bool countsDistances() const { return is(AssignmentEngine::Hamerly) || is(AssignmentEngine::Yinyang) ||
+                                          is(AssignmentEngine::Filtering); }
+    size_t memory() const { return engineMemory(hamerly, yinyang, filtering, gemm); }
+
+    // Called by one thread before every assignment.
+    void update(const DataPoints& centroids) {
+        if (is(AssignmentEngine::Hamerly)) hamerly.update(centroids);
+        if (is(AssignmentEngine::Yinyang)) yinyang.update(centroids);
+        if (is(AssignmentEngine::Gemm)) gemm.update(centroids);
+    }
+
+    // The filtering engine assigns and sums all the points at once, with
+    // tasks run by the whole team.
+    size_t filter(const DataPoints& centroids, FloatSums& sums) {
+        return filtering.update(centroids, sums.totalSumColumns(), sums.totalSizeData());
+    }
+
+    // Labels of points [first, first + count), which `columns` hold from
+    // `offset` on; the kernel writes them to `labels`.
+    template<typename Source>
+    const int* assign(const Source& source, const float* const* columns, size_t offset, size_t first, size_t count,
+                      const AssignmentKernel& kernel, const float* const* centroidColumns, int clusterNum,
+                      int* labels, IterationCounters& counters) {
+        if constexpr (is_same_v<Source, FloatSource>) {
+            const DataPoints& points = source.dataPoints();
+            if (is(AssignmentEngine::Hamerly)) {
+                counters.distanceEvaluations += hamerly.assign(points, first, first + count);
+                return hamerly.labels() + first;
+            }
+            if (is(AssignmentEngine::Yinyang)) {
+                counters.distanceEvaluations += yinyang.assign(points, first, first + count);
+                return yinyang.labels() + first;
+            }
+            if (is(AssignmentEngine::Gemm)) {
+                counters.rescannedPoints += gemm.assign(points, first, first + count, labels);
+                return labels;
+            }
+        }
+        kernel.assign(columns, offset, count, centroidColumns, source.dimension(), clusterNum, labels);
+        return labels;
+    }
+
+private:
+    const AssignmentEngine engine;
+    const DataPoints noPoints;
+    HamerlyEngine hamerly;
+    YinyangEngine yinyang;
+    FilteringEngine filtering;
+    GemmEngine gemm;
+};
+
+// Share [first, last) of `member` out of memberNum, as schedule(static) splits
+// a loop.
+pair<int, int> memberShare(int count, int member, int memberNum) {
+    return {member * count / memberNum, (member + 1) * count / memberNum};
+}
+
+// The parts of kMeansParallel with shardNum * threadNum threads (shardRows):
+// every thread of a shard fills its own part, at least when the team has
+// all of its threads.
+class StaticParts {
+public:
+    StaticParts(size_t pointNum, int shard, int shardNum, int threadNum)
+            : pointNum(pointNum), threadNum(threadNum), partNum(shardNum * threadNum), firstPart(shard * threadNum),
+              firstRow(shardRows(pointNum, shard, shardNum, threadNum).first) {}
+
+    int parts() const { return partNum; }
+    bool needsReset() const { return false; }
+    void reset() {}
+
+    // Calls visit(part, first, end) for the parts of `member`, with the rows
+    // of this shard.
+    template<typename Visit>
+    void forEach(int member, int memberNum, Visit&& visit) {
+        const auto share = memberShare(threadNum, member, memberNum);
+        for (int thread = share.first; thread < share.second; thread++) {
+            const auto rows = shardRows(pointNum, firstPart + thread, partNum, 1);
+            visit(firstPart + thread, rows.first - firstRow, rows.first - firstRow + rows.second);
+        }
+    }
+
+private:
+    const size_t pointNum;
+    const int threadNum;
+    const int partNum;
+    const int firstPart;
+    const size_t firstRow;
+};
+
+// A few chunks of blocks per worker; a worker that runs out of chunks steals
+// from the others.
+class StolenChunks {
+public:
+    StolenChunks(size_t pointNum, int workerNum)
+            : pointNum(pointNum), blockNum((pointNum + ASSIGNMENT_BLOCK_SIZE - 1) / ASSIGNMENT_BLOCK_SIZE),
+              chunkNum(min(blockNum, static_cast<size_t>(POOL_CHUNKS_PER_WORKER) * workerNum)),
+              workerNum(workerNum) {}
+
+    int parts() const { return static_cast<int>(max<size_t>(chunkNum, 1)); }
+    bool needsReset() const { return true; }
+    void reset() { chunks.reset(chunkNum, workerNum); }
+
+    template<typename Visit>
+    void forEach(int worker, int, Visit&& visit) {
+        size_t chunk;
+        while (chunks.next(worker, chunk)) {
+            visit(static_cast<int>(chunk), chunk * blockNum / chunkNum * ASSIGNMENT_BLOCK_SIZE,
+                  min(pointNum, (chunk + 1) * blockNum / chunkNum * ASSIGNMENT_BLOCK_SIZE));
+        }
+    }
+
+private:
+    const size_t pointNum;
+    const size_t blockNum;
+    const size_t chunkNum;
+    const int workerNum;
+    ChunkStealer chunks;
+};
+
+// The threads running the iterations: an OpenMP team, which may have fewer
+// threads than requested, or the workers of a WorkerPool.
+class OpenMPTeam {
+public:
+    explicit OpenMPTeam(int threadNum) : threadNum(threadNum) {}
+
+    int size() const { return threadNum; }
+
+    template<typename Body>
+    void run(Body&& body) {
+#pragma omp parallel num_threads(threadNum)
+        body(omp_get_thread_num(), omp_get_num_threads());
+    }
+
+    void wait() {
+#pragma omp barrier
+    }
+
+private:
+    const int threadNum;
+};
+
+class PoolTeam {
+public:
+    PoolTeam(WorkerPool& pool, int workerNum) : pool(pool), workerNum(workerNum), barrier(workerNum) {}
+
+    int size() const { return workerNum; }
+
+    template<typename Body>
+    void run(Body&& body) {
+        pool.run(workerNum, [&](int worker) { body(worker, workerNum); });
+    }
+
+    void wait() { barrier.wait(); }
+
+private:
+    WorkerPool& pool;
+    const int workerNum;
+    SpinBarrier barrier;
+};
+
+// What lloydIterations does besides assigning and updating.
+struct IterationHooks {
+    // Called by one thread (the master thread of an OpenMP team) between the
+    // assignment and the merge, e.g. to share the sums with the other shards.
+    function<void(IterationCounters&)> exchange;
+    // Receives the labels of the last assignment.
+    vector<int>* labels = nullptr;
+    // Stop on the centroid shift alone, without keeping labels.
+    bool shiftOnly = false;
+};
+
+// Centroids refined by lloydIterations, with their sums.
+template<typename Sums>
+struct CentroidSet {
+    DataPoints* centroids;
+    Sums sums;
+    int iterations = 0;
+    bool converged = false;
+};
+
+// Lloyd iterations over `source` for every set of centroids at once (several
+// only for kMeansRestarts, which runs without engines or printing): each
+// block of points is assigned to every set while it is in cache, and a set
+// stops once it has converged. `pointNum` counts the points of every shard.
+template<typename Source, typename Sums, typename Schedule, typename Team>
+KMeansRun lloydIterations(const Source& source, vector<CentroidSet<Sums>>& sets, Schedule& schedule, Team& team,
+                          Engines& engines, const LloydOptions& options, size_t pointNum,
+                          const IterationHooks& hooks) {
+    const int dimension = source.dimension();
+    const int clusterNum = static_cast<int>(sets[0].centroids->size());
+    const int setNum = static_cast<int>(sets.size());
+    const AssignmentKernel kernel = selectAssignmentKernel(dimension, clusterNum);
+    vector<vector<const float*>> centroidColumns;
+    for (const auto& set : sets) centroidColumns.push_back(set.centroids->columnData());
+    const bool filtering = engines.is(AssignmentEngine::Filtering);
+    vector<int> trackedLabels;
+    const bool trackLabels =
+            hooks.labels != nullptr || (options.stopOnConvergence && !filtering && !hooks.shiftOnly);
+    vector<int>& pointLabels = hooks.labels ? *hooks.labels : trackedLabels;
+    if (trackLabels) pointLabels.assign(source.size(), -1);
+    vector<int> active(setNum);
+    for (int set = 0; set < setNum; set++) active[set] = set;
+    vector<IterationCounters> memberCounters(team.size());
+    IterationCounters counters;
+    vector<float> shifts(static_cast<size_t>(setNum) * clusterNum);
+    KMeansRun run;
+    if (options.metrics) options.metrics->reset(options.iterationNum, team.size());
+
+    auto printing = high_resolution_clock::duration::zero();
+    auto startTime = high_resolution_clock::now();
+    team.run([&](int member, int memberNum) {
+        typename Source::Buffer sourceBuffer(dimension);
+        typename Sums::Buffer sumsBuffer(dimension);
+        int blockLabels[ASSIGNMENT_BLOCK_SIZE];
+        PhaseTimer timer(options.metrics);
+        for (int iteration = 0; iteration < options.iterationNum && !active.empty(); iteration++) {
+            timer.restart();
+            // Only the master thread touches the totals of the counters.
+            if (member == 0) counters = IterationCounters();
+            if (engines.needsUpdate() || schedule.needsReset()) {
+                if (member == 0) {
+                    engines.update(*sets[0].centroids);
+                    schedule.reset();
+                    if constexpr (is_same_v<Sums, FloatSums>) {
+                        if (filtering) counters.distanceEvaluations = engines.filter(*sets[0].centroids, sets[0].sums);
+                    }
+                }
+                team.wait();
+            }
+
+            IterationCounters& own = memberCounters[member];
+            own = IterationCounters();
+            schedule.forEach(member, memberNum, [&](int part, size_t first, size_t end) {
+                if (filtering) return;
+                for (int set : active) sets[set].sums.clear(part);
+                for (size_t block = first; block < end; block += ASSIGNMENT_BLOCK_SIZE) {
+                    const size_t blockSize = min(ASSIGNMENT_BLOCK_SIZE, end - block);
+                    size_t offset;
+                    const float* const* columns = source.block(block, blockSize, sourceBuffer, offset);
+                    for (int set : active) {
+                        const int* assigned = engines.assign(source, columns, offset, block, blockSize, kernel,
+                                                             centroidColumns[set].data(), clusterNum, blockLabels,
+                                                             own);
+                        sets[set].sums.add(part, columns, offset, block, blockSize, assigned, kernel, sumsBuffer);
+                        if (trackLabels) {
+                            for (size_t i = 0; i < blockSize; i++) {
+                                own.changedPoints += pointLabels[block + i] != assigned[i];
+                                pointLabels[block + i] = assigned[i];
+                            }
+                        }
+                    }
+                }
+            });
+            team.wait();
+            timer.stop(iteration, member, ASSIGNMENT_PHASE);
+
+            if (member == 0) {
+                for (const auto& memberCounter : memberCounters) counters.add(memberCounter);
+                if (hooks.exchange) hooks.exchange(counters);
+            }
+            if (hooks.exchange) team.wait();
+
+            // Each cluster of each set is merged and updated by exactly one
+            // thread: no atomics needed.
+            const auto units = memberShare(static_cast<int>(active.size()) * clusterNum, member, memberNum);
+            if (!filtering) {
+                for (int unit = units.first; unit < units.second; unit++) {
+                    sets[active[unit / clusterNum]].sums.merge(unit % clusterNum, sumsBuffer);
+                }
+                team.wait();
+            }
+            timer.stop(iteration, member, REDUCTION_PHASE);
+
+            for (int unit = units.first; unit < units.second; unit++) {
+                const int set = active[unit / clusterNum];
+                const int i = unit % clusterNum;
+                const Sums& sums = sets[set].sums;
+                DataPoints& centroids = *sets[set].centroids;
+                const auto clusterSize = sums.size(i);
+                shifts[static_cast<size_t>(set) * clusterNum + i] = 0;
+                if (sums.keepsEmptyClusters() && clusterSize == 0) continue;
+                float squaredShift = 0;
+                for (int d = 0; d < dimension; d++) {
+                    float coordinate = static_cast<float>(sums.sum(i, d) / clusterSize);
+                    float difference = coordinate - centroids[d][i];
+                    squaredShift += difference * difference;
+                    centroids[d][i] = coordinate;
+                }
+                shifts[static_cast<size_t>(set) * clusterNum + i] = sqrt(squaredShift);
+            }
+            team.wait();
+            timer.stop(iteration, member, UPDATE_PHASE);
+
+            // Convergence is decided here; the barrier below publishes it to
+            // every thread, so stopping needs no extra synchronization.
+            if (member == 0) {
+                vector<int> stillActive;
+                float maxShift = 0;
+                for (int set : active) {
+                    maxShift = *max_element(shifts.begin() + static_cast<size_t>(set) * clusterNum,
+                                            shifts.begin() + static_cast<size_t>(set + 1) * clusterNum);
+                    sets[set].iterations++;
+                    sets[set].converged = options.stopOnConvergence &&
+                                          ((trackLabels && counters.changedPoints == 0) ||
+                                           maxShift <= options.convergenceTolerance);
+                    if (!sets[set].converged) stillActive.push_back(set);
+                }
+                if (options.verbose) {
+                    auto printStart = high_resolution_clock::now();
+                    cout << endl << "Iteration " << options.firstIterationNumber + iteration << ":" << endl << endl;
+                    for (int i = 0; i < clusterNum; i++) {
+                        cout << "Cluster" << i + 1;
+                        sets[0].sums.printSize(i);
+                        cout << endl;
+                    }
+                    if (engines.countsDistances()) {
+                        double bruteForceEvaluations = static_cast<double>(pointNum) * clusterNum;
+                        cout << "Distance evaluations avoided: " << 100 * (1 - counters.distanceEvaluations / bruteForceEvaluations) << "%, engine memory: "
+                             << engines.memory() / 1e6 << " MB" << endl;
+                    }
+                    if (engines.is(AssignmentEngine::Gemm)) {
+                        cout << "Near ties scanned again: " << counters.rescannedPoints << " points" << endl;
+                    }
+                    if (trackLabels && options.stopOnConvergence) {
+                        cout << "Points changed cluster: " << counters.changedPoints << ", max centroid shift: "
+                             << maxShift << endl;
+                    } else if (options.stopOnConvergence) {
+                        cout << "Max centroid shift: " << maxShift << endl;
+                    }
+                    cout << endl;
+                    printCentroids(*sets[0].centroids);
+                    printing += high_resolution_clock::now() - printStart;
+                }
+                active = stillActive;
+                run.iterations++;
+            }
+            team.wait();
+        }
+    });
+    auto endTime = high_resolution_clock::now();
+    run.duration = duration_cast<microseconds>(endTime - startTime - printing).count() / 1000.f;
+    run.converged = options.stopOnConvergence && active.empty();
+    run.engineMemory = engines.memory();
+    if (options.metrics) options.metrics->finish(run.iterations);
+    return run;
+}
+
+}
+
+KMeansRun kMeansSequentialAoS(const float* points, size_t pointNum, DataPoints& centroids, const LloydOptions& options) {
+    return kMeansAoS(points, pointNum, centroids, options, make_integer_sequence<int, MAX_AOS_DIMENSION>());
+}
+
+KMeansRun kMeansSequentialSoA(const DataPoints& dataPoints, DataPoints& centroids, const LloydOptions& options) {
+    // One thread filling one part: the sums are those of a plain loop.
+    LloydOptions sequential = options;
+    sequential.threadNum = 1;
+    return kMeansParallel(dataPoints, centroids, sequential);
+}
+
+KMeansRun kMeansCompact(const CompactPoints& points, DataPoints& centroids, const LloydOptions& options) {
+    const int dimension = points.dimension();
+    const int clusterNum = static_cast<int>(centroids.size());
+    StaticParts schedule(points.size(), 0, 1, options.threadNum);
+    OpenMPTeam team(options.threadNum);
+    Engines engines(AssignmentEngine::BruteForce, DataPoints(dimension), 1);
+    vector<CentroidSet<DoubleSums<NoWeights>>> sets;
+    sets.push_back({&centroids, DoubleSums<NoWeights>(schedule.parts(), dimension, clusterNum, NoWeights(), false)});
+    return lloydIterations(CompactSource(points), sets, schedule, team, engines, options, points.size(),
+                           IterationHooks());
+}
+
+KMeansRun kMeansWeighted(const DataPoints& dataPoints, const vector<float>& weights, DataPoints& centroids,
+                         const LloydOptions& options, vector<int>* labels) {
+    const int dimension = dataPoints.dimension();
+    const int clusterNum = static_cast<int>(centroids.size());
+    StaticParts schedule(dataPoints.size(), 0, 1, options.threadNum);
+    OpenMPTeam team(options.threadNum);
+    Engines engines(AssignmentEngine::BruteForce, dataPoints, 1);
+    vector<CentroidSet<DoubleSums<PointWeights>>> sets;
+    sets.push_back({&centroids, DoubleSums<PointWeights>(schedule.parts(), dimension, clusterNum,
+                                                         PointWeights{weights.data()}, true)});
+    IterationHooks hooks;
+    hooks.labels = labels;
+    return lloydIterations(FloatSource(dataPoints), sets, schedule, team, engines, options, dataPoints.size(), hooks);
+}
+
+KMeansRun kMeansRestarts(const DataPoints& dataPoints, vector<DataPoints>& restarts, const LloydOptions& options,
+                         vector<RestartResult>& results) {
+    const int dimension = dataPoints.dimension();
+    const int restartNum = static_cast<int>(restarts.size());
+    const int clusterNum = restarts.empty() ? 0 : static_cast<int>(restarts[0].size());
+    const size_t pointNum = dataPoints.size();
+    const int threadNum = options.threadNum;
+    results.assign(restartNum, RestartResult{0, 0, false});
+    KMeansRun run;
+    if (restarts.empty()) return run;
+
+    auto startTime = high_resolution_clock::now();
+    StaticParts schedule(pointNum, 0, 1, threadNum);
+    OpenMPTeam team(threadNum);
+    Engines engines(AssignmentEngine::BruteForce, dataPoints, 1);
+    vector<CentroidSet<FloatSums>> sets;
+    sets.reserve(restartNum);
+    for (auto& centroids : restarts) sets.push_back({&centroids, FloatSums(schedule.parts(), dimension, clusterNum)});
+    LloydOptions silent = options;
+    silent.verbose = false;
+    IterationHooks hooks;
+    hooks.shiftOnly = true;
+    run = lloydIterations(FloatSource(dataPoints), sets, schedule, team, engines, silent, pointNum, hooks);
+
+    // A last pass measures the inertia of every restart, with one partial
+    // inertia per part and restart added up in part order.
+    const AssignmentKernel kernel = selectAssignmentKernel(dimension, clusterNum);
+    const vector<const float*> pointColumns = dataPoints.columnData();
+    vector<double> partInertias(static_cast<size_t>(threadNum) * restartNum);
+#pragma omp parallel for schedule(static) num_threads(threadNum)
+    for (int part = 0; part < threadNum; part++) {
+        int labels[ASSIGNMENT_BLOCK_SIZE];
+        float distances[ASSIGNMENT_BLOCK_SIZE];
+        float secondDistances[ASSIGNMENT_BLOCK_SIZE];
+        const auto rows = shardRows(pointNum, part, threadNum, 1);
+        for (size_t block = rows.first; block < rows.first + rows.second; block += ASSIGNMENT_BLOCK_SIZE) {
+            const size_t blockSize = min(ASSIGNMENT_BLOCK_SIZE, rows.first + rows.second - block);
+            for (int restart = 0; restart < restartNum; restart++) {
+                const vector<const float*> centroids = restarts[restart].columnData();
+                kernel.assignWithDistances(pointColumns.data(), block, blockSize, centroids.data(), dimension,
+                                           clusterNum, labels, distances, secondDistances);
+                double blockInertia = 0;
+                for (size_t i = 0; i < blockSize; i++) blockInertia += distances[i];
+                partInertias[static_cast<size_t>(part) * restartNum + restart] += blockInertia;
+            }
+        }
+    }
+    for (int restart = 0; restart < restartNum; restart++) {
+        results[restart].iterations = sets[restart].iterations;
+        results[restart].converged = sets[restart].converged;
+        for (int part = 0; part < threadNum; part++) {
+            results[restart].inertia += partInertias[static_cast<size_t>(part) * restartNum + restart];
+        }
+    }
+    auto endTime = high_resolution_clock::now();
+    run.duration = duration_cast<microseconds>(endTime - startTime).count() / 1000.f;
+    return run;
+}
+
+int bestRestart(const vector<RestartResult>& results) {
+    int best = -1;
+    for (int restart = 0; restart < static_cast<int>(results.size()); restart++) {
+        if (isnan(results[restart].inertia)) continue;
+        if (best < 0 || results[restart].inertia < results[best].inertia) best = restart;
+    }
+    return max(best, 0);
+}
+
+KMeansRun kMeansWarmStart(const DataPoints& newPoints, Checkpoint& checkpoint, const LloydOptions& options,
+                          vector<int>& labels) {
+    const int dimension = newPoints.dimension();
+    const int clusterNum = static_cast<int>(checkpoint.centroids.size());
+    StaticParts schedule(newPoints.size(), 0, 1, options.threadNum);
+    OpenMPTeam team(options.threadNum);
+    Engines engines(AssignmentEngine::BruteForce, newPoints, 1);
+    // The points the checkpoint covers stay in the clusters their sums are
+    // counted in.
+    vector<CentroidSet<DoubleSums<NoWeights>>> sets;
+    sets.push_back({&checkpoint.centroids,
+                    DoubleSums<NoWeights>(schedule.parts(), dimension, clusterNum, NoWeights(), true,
+                                          checkpoint.sums.data(), checkpoint.counts.data())});
+    IterationHooks hooks;
+    hooks.labels = &labels;
+    KMeansRun run = lloydIterations(FloatSource(newPoints), sets, schedule, team, engines, options, newPoints.size(),
+                                    hooks);
+
+    if (run.iterations > 0) {
+        const auto& newSums = sets[0].sums.pointSums();
+        const auto& newSizes = sets[0].sums.pointSizes();
+        for (size_t index = 0; index < newSums.size(); index++) checkpoint.sums[index] += newSums[index];
+        for (int i = 0; i < clusterNum; i++) checkpoint.counts[i] += newSizes[i];
+        checkpoint.rows += newPoints.size();
+    }
+    return run;
+}
+
+pair<size_t, size_t> shardRows(size_t pointNum, int shard, int shardNum, int threadNum) {
+    // Blocks are split like schedule(static): the first blockNum % parts
+    // parts take one extra block.
+    const size_t blockNum = (pointNum + ASSIGNMENT_BLOCK_SIZE - 1) / ASSIGNMENT_BLOCK_SIZE;
+    const size_t parts = static_cast<size_t>(shardNum) * threadNum;
+    auto firstBlock = [&](size_t part) { return part * (blockNum / parts) + min(part, blockNum % parts); };
+    const size_t first = firstBlock(static_cast<size_t>(shard) * threadNum) * ASSIGNMENT_BLOCK_SIZE;
+    const size_t end = min(pointNum, firstBlock(static_cast<size_t>(shard + 1) * threadNum) * ASSIGNMENT_BLOCK_SIZE);
+    return {min(first, pointNum), end - min(first, end)};
+}
+
+KMeansRun kMeansParallel(const DataPoints& dataPoints, DataPoints& centroids, const LloydOptions& options) {
+    return kMeansDistributed(dataPoints, dataPoints.size(), centroids, options, ShardExchange());
+}
+
+KMeansRun kMeansPooled(const DataPoints& dataPoints, DataPoints& centroids, const LloydOptions& options,
+                       WorkerPool& pool) {
+    const int workerNum = max(1, options.threadNum);
+    if (options.engine == AssignmentEngine::Filtering) {
+        cerr << "Error: the filtering engine cannot run on the worker pool" << endl;
+        return KMeansRun();
+    }
+    StolenChunks schedule(dataPoints.size(), workerNum);
+    PoolTeam team(pool, workerNum);
+    Engines engines(options.engine, dataPoints, workerNum);
+    vector<CentroidSet<FloatSums>> sets;
+    sets.push_back({&centroids, FloatSums(schedule.parts(), dataPoints.dimension(), static_cast<int>(centroids.size()))});
+    return lloydIterations(FloatSource(dataPoints), sets, schedule, team, engines, options, dataPoints.size(),
+                           IterationHooks());
+}
+
+KMeansRun kMeansDistributed(const DataPoints& dataPoints, size_t pointNum, DataPoints& centroids,
+                            const LloydOptions& options, const ShardExchange& exchange) {
+    if (options.engine == AssignmentEngine::Filtering && exchange.shardNum > 1) {
+        cerr << "Error: the filtering engine cannot run on a sharded dataset" << endl;
+        return KMeansRun();
+    }
+    const int threadNum = options.threadNum;
+    StaticParts schedule(pointNum, exchange.shard, exchange.shardNum, threadNum);
+    OpenMPTeam team(threadNum);
+    Engines engines(options.engine, dataPoints, threadNum);
+    vector<CentroidSet<FloatSums>> sets;
+    sets.push_back({&centroids, FloatSums(schedule.parts(), dataPoints.dimension(), static_cast<int>(centroids.size()))});
+    // Every shard fills the slices of its own threads; afterwards all the
+    // slices are merged in the same order on every shard. Only the master
+    // thread calls exchange.
+    IterationHooks hooks;
+    if (exchange.shardNum > 1) {
+        hooks.exchange = [&](IterationCounters& counters) {
+            ClusterAccumulators& accumulators = sets[0].sums.parts();
+            exchange.gatherFloats(accumulators.allSums(), accumulators.sumsPerThread() * threadNum);
+            exchange.gatherInts(accumulators.allSizes(), accumulators.sizesPerThread() * threadNum);
+            size_t values[] = {counters.distanceEvaluations, counters.rescannedPoints, counters.changedPoints};
+            exchange.sum(values, 3);
+            counters.distanceEvaluations = values[0];
+            counters.rescannedPoints = values[1];
+            counters.changedPoints = values[2];
+        };
+    }
+    return lloydIterations(FloatSource(dataPoints), sets, schedule, team, engines, options, pointNum, hooks);
+}
@@ -0,0 +1,145 @@
+#ifndef K_MEANS_LLOYD_H
+#define K_MEANS_LLOYD_H
+
+#include "checkpoint.h"
+#include "compact_points.h"
+#include "data_points.h"
+#include "filtering_engine.h"
+#include "gemm_engine.h"
+#include "hamerly_engine.h"
+#include "iteration_metrics.h"
+#include "worker_pool.h"
+#include "yinyang_engine.h"
+#include <cstddef>
+#include <functional>
+#include <utility>
+#include <vector>
+
+// The AoS version stores points as DataPoint<D>, compiled for every
+// dimension up to this one.
+static const int MAX_AOS_DIMENSION = 16;
+
+// Hamerly keeps per-point distance bounds (hamerly_engine.h), Yinyang one
+// bound per group of centroids (yinyang_engine.h); Filtering walks a kd-tree
+// built over the points (filtering_engine.h). Gemm scans every centroid, as
+// a cache-blocked matrix product (gemm_engine.h). All produce the brute-force
+// assignments.
+enum class AssignmentEngine { BruteForce, Hamerly, Yinyang, Filtering, Gemm };
+
+struct LloydOptions {
+    int iterationNum = 10;
+    // Stop as soon as no point changes cluster or no centroid moves by more
+    // than convergenceTolerance; iterationNum is then an upper bound. The
+    // Filtering engine keeps no per-point labels and only checks the shift.
+    bool stopOnConvergence = false;
+    float convergenceTolerance = 1e-4f;
+    // Ignored by the AoS version, which always scans every centroid.
+    AssignmentEngine engine = AssignmentEngine::BruteForce;
+    int threadNum = 1;
+    // Prints cluster sizes and centroids after every iteration, outside of
+    // the measured time.
+    bool verbose = true;
+    // Number printed for the first iteration, e.g. 2 when the first one ran
+    // while the dataset was loaded.
+    int firstIterationNumber = 1;
+    // When set, receives the time (and hardware events) of every phase of
+    // every iteration on every thread. Not used by the AoS version.
+    IterationMetrics* metrics = nullptr;
+};
+
+struct KMeansRun {
+    // Milliseconds spent in the iterations, excluding any layout conversion
+    // and the verbose output.
+    float duration = 0;
+    int iterations = 0;
+    bool converged = false;
+    // Bytes held by the assignment engine (bounds or tree); 0 for brute force.
+    std::size_t engineMemory = 0;
+};
+
+// Lloyd iterations starting from `centroids`, which receive the result.
+// The AoS version reads `pointNum` interleaved points of centroids.dimension()
+// coordinates each.
+KMeansRun kMeansSequentialAoS(const float* points, std::size_t pointNum, DataPoints& centroids,
+                              const LloydOptions& options);
+KMeansRun kMeansSequentialSoA(const DataPoints& points, DataPoints& centroids, const LloydOptions& options);
+KMeansRun kMeansParallel(const DataPoints& points, DataPoints& centroids, const LloydOptions& options);
+// kMeansParallel on options.threadNum workers of `pool` instead of an OpenMP
+// region; the workers meet at spinning barriers between the phases. The
+// blocks are split into a few chunks per worker, and a worker that runs out
+// of chunks steals from the others. Every chunk has its own cluster sums,
+// merged in chunk order, so the centroids depend on the number of workers
+// but not on which worker ran which chunk. The Filtering engine runs on
+// OpenMP tasks and is not supported.
+KMeansRun kMeansPooled(const DataPoints& points, DataPoints& centroids, const LloydOptions& options,
+                       WorkerPool& pool);
+// Brute-force Lloyd iterations over 16-bit points on options.threadNum
+// threads: every block is decoded to float for the assignment kernel, and
+// the cluster sums are kept in double. The engine option is ignored.
+KMeansRun kMeansCompact(const CompactPoints& points, DataPoints& centroids, const LloydOptions& options);
+// Brute-force Lloyd iterations over weighted points (e.g. a coreset) on
+// options.threadNum threads: a point counts weights[i] times in the sums and
+// in the size of its cluster, so the sizes are sums of weights. A cluster
+// without weight keeps its centroid. The engine option is ignored. When
+// `labels` is set it receives the clusters of the last assignment, the ones
+// the final centroids are the means of.
+KMeansRun kMeansWeighted(const DataPoints& points, const std::vector<float>& weights, DataPoints& centroids,
+                         const LloydOptions& options, std::vector<int>* labels = nullptr);
+
+struct RestartResult {
+    // Sum of the squared distances of the points to their nearest final
+    // centroid.
+    double inertia;
+    int iterations;
+    bool converged;
+};
+
+// Brute-force Lloyd iterations from every centroid set of `restarts` at once,
+// on options.threadNum threads: each block of points is read from memory once
+// and assigned to the centroids of every restart while it is in cache. Each
+// restart gets the centroids and the iterations of kMeansParallel with the
+// same threads, but stops on the centroid shift alone: no labels are kept.
+// A last pass measures the inertia of every restart, and nothing is printed
+// along the way. The returned run covers all the restarts: it converged if
+// all of them did.
+KMeansRun kMeansRestarts(const DataPoints& points, std::vector<DataPoints>& restarts, const LloydOptions& options,
+                         std::vector<RestartResult>& results);
+// The restart with the lowest inertia. Restarts with a NaN inertia (e.g. from
+// an empty cluster) are skipped; 0 if all of them have one.
+int bestRestart(const std::vector<RestartResult>& results);
+
+// Warm start from `checkpoint`: brute-force Lloyd iterations over `newPoints`
+// alone, on options.threadNum threads. The points the checkpoint already
+// covers stay in the clusters their sums are counted in, and every centroid
+// is the mean of its old and new points (a centroid without points does not
+// move). Afterwards the checkpoint also covers the new points, and `labels`
+// holds their clusters. From an emptyCheckpoint() this is a plain k-means.
+KMeansRun kMeansWarmStart(const DataPoints& newPoints, Checkpoint& checkpoint, const LloydOptions& options,
+                          std::vector<int>& labels);
+
+// How the processes of a distributed run (e.g. MPI ranks) share their
+// partial results. Every call is collective: all the shards make the same
+// calls in the same order.
+struct ShardExchange {
+    int shard = 0;
+    int shardNum = 1;
+    // `values` holds shardNum slices of `size` elements and this shard filled
+    // slice `shard`; afterwards every slice holds the one of its shard.
+    std::function<void(float* values, std::size_t size)> gatherFloats;
+    std::function<void(int* values, std::size_t size)> gatherInts;
+    // Replaces `values` with their sums over all the shards.
+    std::function<void(std::size_t* values, int count)> sum;
+};
+
+// Rows [first, first + count) that `shard` holds when `pointNum` points are
+// split across shardNum processes of threadNum threads each.
+std::pair<std::size_t, std::size_t> shardRows(std::size_t pointNum, int shard, int shardNum, int threadNum);
+
+// kMeansParallel over the shardRows() of every process. Cluster sums are
+// merged in the same order as kMeansParallel with shardNum * threadNum
+// threads, so the centroids are identical to that run. The Filtering engine
+// needs all the points and is not supported.
+KMeansRun kMeansDistributed(const DataPoints& shardPoints, std::size_t pointNum, DataPoints& centroids,
+                            const LloydOptions& options, const ShardExchange& exchange);
+
+#endif //K_MEANS_LLOYD_H
@@ -0,0 +1,40 @@
+#include "mapped_file.h"
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    struct stat info{};
+    if (fstat(fd, &info) == 0) {
+        length = static_cast<std::size_t>(info.st_size);
+        if (length == 0) {
+            opened = true;
+        } else {
+            void* mapping = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_NORESERVE, fd, 0);
+            if (mapping != MAP_FAILED) {
+                address = mapping;
+                opened = true;
+            }
+        }
+    }
+    close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (address != nullptr) munmap(address, length);
+}
+
+void MappedFile::advise(int advice) {
+    if (address != nullptr) madvise(address, length, advice);
+}
+
+void MappedFile::advise(int advice, std::size_t offset, std::size_t size) {
+    const auto pageSize = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    std::size_t begin = (offset + pageSize - 1) / pageSize * pageSize;
+    std::size_t end = std::min(offset + size, length) / pageSize * pageSize;
+    if (address != nullptr && begin < end) madvise(data() + begin, end - begin, advice);
+}
@@ -0,0 +1,32 @@
+#ifndef K_MEANS_MAPPED_FILE_H
+#define K_MEANS_MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+// View of a whole file through mmap. The mapping is private, so pages are
+// shared with the page cache until somebody writes to them, and reserves no
+// swap, so files larger than memory can be mapped.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool isOpen() const { return opened; }
+    const char* data() const { return static_cast<const char*>(address); }
+    char* data() { return static_cast<char*>(address); }
+    std::size_t size() const { return length; }
+    void advise(int advice);
+    // Advice for the whole pages inside [offset, offset + size).
+    void advise(int advice, std::size_t offset, std::size_t size);
+
+private:
+    void* address = nullptr;
+    std::size_t length = 0;
+    bool opened = false;
+};
+
+#endif //K_MEANS_MAPPED_FILE_H
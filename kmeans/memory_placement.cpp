@@ -0,0 +1,137 @@
+#include "memory_placement.h"
+#include "lloyd.h"
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <omp.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+const size_t HUGE_PAGE_SIZE = 2 << 20;
+// Pages queried by pagePlacement at most; larger datasets are sampled.
+const size_t MAX_SAMPLED_PAGES = 1 << 16;
+
+// Anonymous memory for `count` floats, unmapped together with `owner`. No
+// page is touched here.
+float* allocateColumn(size_t count, HugePages hugePages, shared_ptr<void>& owner, bool& fellBack) {
+    size_t bytes = max<size_t>(count * sizeof(float), 1);
+    void* address = MAP_FAILED;
+    if (hugePages == HugePages::Explicit) {
+        bytes = (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+        address = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        fellBack = fellBack || address == MAP_FAILED;
+    }
+    if (address == MAP_FAILED) {
+        address = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (address == MAP_FAILED) return nullptr;
+        if (hugePages == HugePages::Transparent) madvise(address, bytes, MADV_HUGEPAGE);
+    }
+    owner = shared_ptr<void>(address, [bytes](void* memory) { munmap(memory, bytes); });
+    return static_cast<float*>(address);
+}
+
+}
+
+const char* hugePagesName(HugePages hugePages) {
+    switch (hugePages) {
+        case HugePages::Transparent: return "transparent";
+        case HugePages::Explicit: return "explicit";
+        default: return "no";
+    }
+}
+
+bool placeForThreads(DataPoints& points, int threadNum, HugePages hugePages) {
+    const size_t pointNum = points.size();
+    bool fellBack = false;
+    for (auto& column : points.columns) {
+        shared_ptr<void> owner;
+        float* values = allocateColumn(pointNum, hugePages, owner, fellBack);
+        if (!values) {
+            cerr << "Error: Unable to allocate " << pointNum * sizeof(float) << " bytes for the points" << endl;
+            return false;
+        }
+        const float* source = column.data();
+        // The rows and threads of the parts of kMeansDistributed.
+#pragma omp parallel for schedule(static) num_threads(threadNum)
+        for (int thread = 0; thread < threadNum; thread++) {
+            const auto rows = shardRows(pointNum, thread, threadNum, 1);
+            memcpy(values + rows.first, source + rows.first, rows.second * sizeof(float));
+        }
+        column.adopt(values, pointNum, owner);
+    }
+    if (fellBack) cerr << "Warning: no explicit huge pages available, normal pages used instead" << endl;
+    return true;
+}
+
+bool pinThreads(int threadNum) {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        cerr << "Error: Unable to read the CPUs of the process" << endl;
+        return false;
+    }
+    vector<int> cpus;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &allowed)) cpus.push_back(cpu);
+    }
+    bool pinned = true;
+#pragma omp parallel num_threads(threadNum) reduction(&&:pinned)
+    {
+        cpu_set_t cpu;
+        CPU_ZERO(&cpu);
+        CPU_SET(cpus[omp_get_thread_num() % cpus.size()], &cpu);
+        pinned = pthread_setaffinity_np(pthread_self(), sizeof(cpu), &cpu) == 0;
+    }
+    if (!pinned) cerr << "Error: Unable to pin the threads to their CPUs" << endl;
+    return pinned;
+}
+
+string pagePlacement(const DataPoints& points) {
+    const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t pageNum = 0;
+    for (const auto& column : points.columns) pageNum += (column.size() * sizeof(float) + pageSize - 1) / pageSize;
+    const size_t stride = max<size_t>(1, (pageNum + MAX_SAMPLED_PAGES - 1) / MAX_SAMPLED_PAGES);
+
+    vector<void*> pages;
+    for (const auto& column : points.columns) {
+        const auto first = reinterpret_cast<uintptr_t>(column.data()) / pageSize * pageSize;
+        const auto end = reinterpret_cast<uintptr_t>(column.data() + column.size());
+        for (uintptr_t page = first; page < end; page += stride * pageSize) {
+            pages.push_back(reinterpret_cast<void*>(page));
+        }
+    }
+    // Without target nodes, move_pages only reports where the pages are.
+    vector<int> status(pages.size());
+    if (pages.empty() ||
+        syscall(SYS_move_pages, 0, pages.size(), pages.data(), nullptr, status.data(), 0) != 0) {
+        return "unknown";
+    }
+    map<int, size_t> nodePages;
+    size_t missing = 0;
+    for (int node : status) {
+        if (node >= 0) {
+            nodePages[node]++;
+        } else {
+            missing++;
+        }
+    }
+    ostringstream placement;
+    placement.precision(3);
+    for (const auto& node : nodePages) {
+        placement << (node.first == nodePages.begin()->first ? "" : ", ") << "node " << node.first << ": "
+                  << 100.0 * node.second / pages.size() << "%";
+    }
+    if (missing > 0) placement << (nodePages.empty() ? "" : ", ") << "not resident: " << 100.0 * missing / pages.size() << "%";
+    return placement.str();
+}
@@ -0,0 +1,30 @@
+#ifndef K_MEANS_MEMORY_PLACEMENT_H
+#define K_MEANS_MEMORY_PLACEMENT_H
+
+#include "data_points.h"
+#include <string>
+
+// Pages backing the points: Transparent asks the kernel to merge them into
+// huge pages (madvise), Explicit takes them from the reserved huge page pool
+// (vm.nr_hugepages) and falls back to normal pages when it is empty.
+enum class HugePages { None, Transparent, Explicit };
+
+const char* hugePagesName(HugePages hugePages);
+
+// Copies every column of `points` into fresh memory whose pages are first
+// touched by the thread that reads them in kMeansParallel with threadNum
+// threads, so that on a NUMA machine each thread's rows live on its node.
+// Must run with the threads already pinned (pinThreads), or the kernel may
+// move them after the pages are placed.
+bool placeForThreads(DataPoints& points, int threadNum, HugePages hugePages);
+
+// Binds OpenMP thread t of a team of threadNum threads to the t-th CPU the
+// process may run on (wrapping around). The runtime keeps its threads from one
+// parallel region to the next, so later teams of the same size stay pinned.
+bool pinThreads(int threadNum);
+
+// Share of the resident pages of `points` on every NUMA node, e.g.
+// "node 0: 50%, node 1: 50%"; pages are sampled on large datasets.
+std::string pagePlacement(const DataPoints& points);
+
+#endif //K_MEANS_MEMORY_PLACEMENT_H
@@ -0,0 +1,271 @@
+#include "pipelined_loader.h"
+#include "assignment_kernel.h"
+#include "binary_dataset.h"
+#include "csv_parser.h"
+#include "dataset_loader.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace chrono;
+
+namespace {
+
+// Bytes the reader reads at a time; a chunk ends at the last newline.
+const size_t CHUNK_BYTES = 4 << 20;
+// Chunks read ahead of the workers at most, per worker.
+const size_t QUEUED_CHUNKS_PER_WORKER = 2;
+
+struct TextChunk {
+    size_t index;
+    string text;
+};
+
+// Bounded FIFO between the reader and the workers.
+class ChunkQueue {
+public:
+    explicit ChunkQueue(size_t capacity) : capacity(capacity) {}
+
+    // Waits while the queue is full.
+    void push(TextChunk chunk) {
+        unique_lock<mutex> lock(guard);
+        notFull.wait(lock, [this] { return chunks.size() < capacity; });
+        chunks.push_back(move(chunk));
+        notEmpty.notify_one();
+    }
+
+    // Waits while the queue is empty; false once it is closed and drained.
+    bool pop(TextChunk& chunk) {
+        unique_lock<mutex> lock(guard);
+        notEmpty.wait(lock, [this] { return !chunks.empty() || closed; });
+        if (chunks.empty()) return false;
+        chunk = move(chunks.front());
+        chunks.pop_front();
+        notFull.notify_one();
+        return true;
+    }
+
+    void close() {
+        lock_guard<mutex> lock(guard);
+        closed = true;
+        notEmpty.notify_all();
+    }
+
+private:
+    size_t capacity;
+    deque<TextChunk> chunks;
+    bool closed = false;
+    mutex guard;
+    condition_variable notFull;
+    condition_variable notEmpty;
+};
+
+// Points of one chunk with the sums and sizes of their clusters.
+struct ChunkResult {
+    DataPoints points;
+    vector<double> sums;
+    vector<size_t> sizes;
+};
+
+// Assigns rows [first, first + count) of `points` and adds them to the
+// cluster `sums` (cluster after cluster) and `sizes`. Blocks are summed in
+// float by the kernel, as in kMeansCompact.
+void sumClusters(const DataPoints& points, size_t first, size_t count, const AssignmentKernel& kernel,
+                 const DataPoints& centroids, vector<double>& sums, vector<size_t>& sizes) {
+    const int dimension = points.dimension();
+    const int clusterNum = static_cast<int>(centroids.size());
+    const vector<const float*> pointColumns = points.columnData();
+    const vector<const float*> centroidColumns = centroids.columnData();
+    sums.assign(static_cast<size_t>(clusterNum) * dimension, 0);
+    sizes.assign(clusterNum, 0);
+    vector<float> blockSums(static_cast<size_t>(dimension) * clusterNum);
+    vector<float*> blockSumColumns(dimension);
+    for (int d = 0; d < dimension; d++) blockSumColumns[d] = blockSums.data() + d * clusterNum;
+    vector<int> blockSizes(clusterNum);
+    int labels[ASSIGNMENT_BLOCK_SIZE];
+    for (size_t block = first; block < first + count; block += ASSIGNMENT_BLOCK_SIZE) {
+        const size_t blockSize = min(ASSIGNMENT_BLOCK_SIZE, first + count - block);
+        kernel.assign(pointColumns.data(), block, blockSize, centroidColumns.data(), dimension, clusterNum, labels);
+        fill(blockSums.begin(), blockSums.end(), 0.f);
+        fill(blockSizes.begin(), blockSizes.end(), 0);
+        kernel.accumulate(pointColumns.data(), block, blockSize, labels, dimension, blockSumColumns.data(),
+                          blockSizes.data());
+        for (int i = 0; i < clusterNum; i++) {
+            sizes[i] += blockSizes[i];
+            for (int d = 0; d < dimension; d++) sums[static_cast<size_t>(i) * dimension + d] += blockSumColumns[d][i];
+        }
+    }
+}
+
+// Replaces `centroids` with the means of the clusters summed by `results`,
+// added up in order.
+void updateCentroids(const vector<ChunkResult>& results, DataPoints& centroids) {
+    const int dimension = centroids.dimension();
+    const int clusterNum = static_cast<int>(centroids.size());
+    vector<double> sums(static_cast<size_t>(clusterNum) * dimension);
+    vector<size_t> sizes(clusterNum);
+    for (const auto& result : results) {
+        for (size_t index = 0; index < sums.size(); index++) sums[index] += result.sums[index];
+        for (int i = 0; i < clusterNum; i++) sizes[i] += result.sizes[i];
+    }
+    for (int i = 0; i < clusterNum; i++) {
+        for (int d = 0; d < dimension; d++) {
+            centroids[d][i] = static_cast<float>(sums[static_cast<size_t>(i) * dimension + d] / sizes[i]);
+        }
+    }
+}
+
+float elapsedMilliseconds(high_resolution_clock::duration time) {
+    return duration_cast<microseconds>(time).count() / 1000.f;
+}
+
+bool loadBinaryWithFirstIteration(DataPoints& dataset, const shared_ptr<MappedFile>& file, const string& fullPath,
+                                  DataPoints& centroids, int threadNum, PipelineReport& report) {
+    auto startTime = high_resolution_clock::now();
+    if (!mapBinaryDataset(dataset, file, fullPath)) return false;
+    if (dataset.dimension() != centroids.dimension()) {
+        cerr << "Error: the centroids have " << centroids.dimension() << " coordinates, the dataset has "
+             << dataset.dimension() << endl;
+        return false;
+    }
+    auto loadedTime = high_resolution_clock::now();
+    const AssignmentKernel kernel = selectAssignmentKernel(dataset.dimension(), static_cast<int>(centroids.size()));
+    vector<ChunkResult> results(threadNum);
+#pragma omp parallel for schedule(static) num_threads(threadNum)
+    for (int part = 0; part < threadNum; part++) {
+        const size_t first = part * dataset.size() / threadNum;
+        const size_t last = (part + 1) * dataset.size() / threadNum;
+        sumClusters(dataset, first, last - first, kernel, centroids, results[part].sums, results[part].sizes);
+    }
+    updateCentroids(results, centroids);
+    auto endTime = high_resolution_clock::now();
+    report = {elapsedMilliseconds(endTime - startTime), elapsedMilliseconds(loadedTime - startTime), 0,
+              elapsedMilliseconds(endTime - loadedTime)};
+    return true;
+}
+
+}
+
+bool loadWithFirstIteration(DataPoints& dataset, const string& fullPath, DataPoints& centroids, int threadNum,
+                            PipelineReport& report) {
+    auto file = make_shared<MappedFile>(fullPath);
+    if (!file->isOpen()) {
+        cerr << "Error: Unable to open file " << fullPath << endl;
+        return false;
+    }
+    if (isBinaryDataset(*file)) {
+        return loadBinaryWithFirstIteration(dataset, file, fullPath, centroids, threadNum, report);
+    }
+    file.reset();
+    FILE* input = fopen(fullPath.c_str(), "rb");
+    if (!input) {
+        cerr << "Error: Unable to open file " << fullPath << endl;
+        return false;
+    }
+
+    const int dimension = centroids.dimension();
+    const AssignmentKernel kernel = selectAssignmentKernel(dimension, static_cast<int>(centroids.size()));
+    ChunkQueue queue(QUEUED_CHUNKS_PER_WORKER * threadNum);
+    vector<ChunkResult> results;
+    mutex resultsGuard;
+    auto startTime = high_resolution_clock::now();
+
+    auto readTime = high_resolution_clock::duration::zero();
+    int fileDimension = 0;
+    bool readError = false;
+    thread reader([&] {
+        string carry;
+        size_t index = 0;
+        while (true) {
+            TextChunk chunk = {index, move(carry)};
+            carry.clear();
+            const size_t carried = chunk.text.size();
+            chunk.text.resize(carried + CHUNK_BYTES);
+            auto readStart = high_resolution_clock::now();
+            const size_t bytes = fread(&chunk.text[carried], 1, CHUNK_BYTES, input);
+            readTime += high_resolution_clock::now() - readStart;
+            chunk.text.resize(carried + bytes);
+            if (bytes == 0) {
+                readError = ferror(input) != 0;
+                if (!chunk.text.empty() && !readError) queue.push(move(chunk));
+                break;
+            }
+            // The last line may continue in the next read.
+            const size_t lineEnd = chunk.text.rfind('\n');
+            if (lineEnd == string::npos) {
+                carry = move(chunk.text);
+                continue;
+            }
+            carry.assign(chunk.text, lineEnd + 1, string::npos);
+            chunk.text.resize(lineEnd + 1);
+            if (fileDimension == 0) fileDimension = csv::detectDimension(chunk.text.data(), chunk.text.data() + lineEnd);
+            queue.push(move(chunk));
+            index++;
+        }
+        queue.close();
+    });
+
+    double parseSeconds = 0;
+    double assignmentSeconds = 0;
+#pragma omp parallel num_threads(threadNum) reduction(+:parseSeconds,assignmentSeconds)
+    {
+        TextChunk chunk;
+        while (queue.pop(chunk)) {
+            ChunkResult result;
+            result.points = DataPoints(dimension);
+            auto parseStart = high_resolution_clock::now();
+            size_t loadedRows;
+            parseCsvText(chunk.text.data(), chunk.text.size(), result.points, loadedRows);
+            auto assignmentStart = high_resolution_clock::now();
+            sumClusters(result.points, 0, result.points.size(), kernel, centroids, result.sums, result.sizes);
+            auto assignmentEnd = high_resolution_clock::now();
+            parseSeconds += duration_cast<microseconds>(assignmentStart - parseStart).count() / 1e6;
+            assignmentSeconds += duration_cast<microseconds>(assignmentEnd - assignmentStart).count() / 1e6;
+            lock_guard<mutex> lock(resultsGuard);
+            if (results.size() <= chunk.index) results.resize(chunk.index + 1);
+            results[chunk.index] = move(result);
+        }
+    }
+    reader.join();
+    fclose(input);
+    if (readError) {
+        cerr << "Error: Unable to read file " << fullPath << endl;
+        return false;
+    }
+    if (fileDimension == 0) {
+        cerr << "Error: No coordinates found in " << fullPath << endl;
+        return false;
+    }
+    if (fileDimension != dimension) {
+        cerr << "Error: the centroids have " << dimension << " coordinates, the dataset has " << fileDimension << endl;
+        return false;
+    }
+
+    // One copy of the points into the SoA arrays, in file order.
+    vector<size_t> firstRows(results.size() + 1, 0);
+    for (size_t c = 0; c < results.size(); c++) firstRows[c + 1] = firstRows[c] + results[c].points.size();
+    dataset = DataPoints(dimension);
+    dataset.resize(firstRows.back());
+#pragma omp parallel for schedule(dynamic, 1) num_threads(threadNum)
+    for (size_t c = 0; c < results.size(); c++) {
+        for (int d = 0; d < dimension; d++) {
+            memcpy(dataset[d].data() + firstRows[c], results[c].points[d].data(),
+                   results[c].points.size() * sizeof(float));
+        }
+        results[c].points = DataPoints();
+    }
+    updateCentroids(results, centroids);
+
+    auto endTime = high_resolution_clock::now();
+    report = {elapsedMilliseconds(endTime - startTime), elapsedMilliseconds(readTime),
+              static_cast<float>(parseSeconds * 1000 / threadNum), static_cast<float>(assignmentSeconds * 1000 / threadNum)};
+    return true;
+}
@@ -0,0 +1,31 @@
+#ifndef K_MEANS_PIPELINED_LOADER_H
+#define K_MEANS_PIPELINED_LOADER_H
+
+#include "data_points.h"
+#include <string>
+
+struct PipelineReport {
+    // Wall time of the whole pipeline, up to the new centroids.
+    float duration;
+    // Wall time the reader spent in fread.
+    float readTime;
+    // Worker time spent parsing and assigning, divided by the number of
+    // workers. These are averages, not wall times: how much of the load the
+    // pipeline hides has to be measured against a load followed by an
+    // iteration.
+    float parseTime;
+    float assignmentTime;
+};
+
+// Loads a CSV dataset while computing the first Lloyd iteration from
+// `centroids`. A reader thread reads the file in newline-aligned chunks into
+// a bounded queue; threadNum workers parse every chunk as soon as it arrives,
+// assign its points and sum its clusters. The chunks are then copied into
+// `dataset` in file order and `centroids` replaced by the cluster means. Sums
+// are merged in chunk order, so the result does not depend on the
+// scheduling. Binary datasets need no parsing: they are mapped, and the
+// iteration runs afterwards.
+bool loadWithFirstIteration(DataPoints& dataset, const std::string& fullPath, DataPoints& centroids, int threadNum,
+                            PipelineReport& report);
+
+#endif //K_MEANS_PIPELINED_LOADER_H
@@ -0,0 +1,115 @@
+#include "point_stream.h"
+#include "binary_dataset.h"
+#include "dataset_loader.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <sys/mman.h>
+
+using namespace std;
+
+// Bytes read from standard input at a time.
+static const size_t INPUT_CHUNK_SIZE = 1 << 20;
+
+namespace {
+
+// End of the first `lines` complete lines of [begin, end), or nullptr if
+// there are fewer.
+const char* findLinesEnd(const char* begin, const char* end, size_t lines) {
+    const char* cursor = begin;
+    for (size_t line = 0; line < lines; line++) {
+        auto newline = static_cast<const char*>(memchr(cursor, '\n', end - cursor));
+        if (!newline) return nullptr;
+        cursor = newline + 1;
+    }
+    return cursor;
+}
+
+}
+
+PointStream::PointStream(const string& fullPath) {
+    standardInput = fullPath == "-";
+    if (standardInput) {
+        opened = true;
+        return;
+    }
+    file = make_shared<MappedFile>(fullPath);
+    if (!file->isOpen()) {
+        cerr << "Error: Unable to open file " << fullPath << endl;
+        return;
+    }
+    file->advise(MADV_SEQUENTIAL);
+    binary = isBinaryDataset(*file);
+    if (binary && !mapBinaryDataset(rows, file, fullPath)) return;
+    opened = true;
+}
+
+bool PointStream::next(size_t batchSize, DataPoints& batch) {
+    if (!opened || error || batchSize == 0) return false;
+    return binary ? nextRows(batchSize, batch) : nextLines(batchSize, batch);
+}
+
+bool PointStream::nextRows(size_t batchSize, DataPoints& batch) {
+    // The previous batch is no longer used by the caller.
+    for (int d = 0; d < rows.dimension() && position > 0; d++) {
+        file->advise(MADV_DONTNEED, reinterpret_cast<const char*>(rows[d].data()) - file->data(),
+                     position * sizeof(float));
+    }
+    if (position >= rows.size()) return false;
+    const size_t count = min(batchSize, rows.size() - position);
+    batch = DataPoints(rows.dimension());
+    for (int d = 0; d < rows.dimension(); d++) batch[d].adopt(rows[d].data() + position, count, file);
+    position += count;
+    return true;
+}
+
+bool PointStream::readInput() {
+    const size_t size = input.size();
+    input.resize(size + INPUT_CHUNK_SIZE);
+    const size_t read = fread(&input[size], 1, INPUT_CHUNK_SIZE, stdin);
+    input.resize(size + read);
+    if (read == 0) {
+        inputEnded = true;
+        if (ferror(stdin)) {
+            cerr << "Error: Unable to read the standard input" << endl;
+            error = true;
+        }
+    }
+    return read > 0;
+}
+
+bool PointStream::nextLines(size_t batchSize, DataPoints& batch) {
+    if (!standardInput && position > 0) file->advise(MADV_DONTNEED, 0, position);
+    // Lines without enough numbers (headers, blank lines) are skipped, so a
+    // batch can come out empty; keep going until one holds points.
+    while (true) {
+        const char* text = standardInput ? input.data() : file->data();
+        const size_t size = standardInput ? input.size() : file->size();
+        const char* begin = text + position;
+        const char* batchEnd = findLinesEnd(begin, text + size, batchSize);
+        if (!batchEnd) {
+            if (standardInput && !inputEnded) {
+                readInput();
+                continue;
+            }
+            batchEnd = text + size;
+        }
+        if (begin == batchEnd) return false;
+
+        DataPoints parsed(rows.dimension());
+        size_t loadedRows = 0;
+        if (parseCsvText(begin, batchEnd - begin, parsed, loadedRows) && rows.dimension() == 0) {
+            rows = DataPoints(parsed.dimension());
+        }
+        if (standardInput) {
+            input.erase(0, batchEnd - text);
+        } else {
+            position = batchEnd - text;
+        }
+        if (loadedRows > 0) {
+            batch = move(parsed);
+            return true;
+        }
+    }
+}
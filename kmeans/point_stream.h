@@ -0,0 +1,46 @@
+#ifndef K_MEANS_POINT_STREAM_H
+#define K_MEANS_POINT_STREAM_H
+
+#include "data_points.h"
+#include "mapped_file.h"
+#include <cstddef>
+#include <memory>
+#include <string>
+
+// Reads a dataset one batch at a time, so that memory stays bounded by the
+// batch size whatever the input size. Binary datasets are handed out as
+// column slices of the mapping (no copy); CSV files and standard input
+// ("-") are parsed a batch of lines at a time. Pages of the batches already
+// consumed are released.
+class PointStream {
+public:
+    explicit PointStream(const std::string& fullPath);
+
+    bool isOpen() const { return opened; }
+    bool isBinary() const { return binary; }
+    // 0 for CSV input until a line holding numbers has been read.
+    int dimension() const { return rows.dimension(); }
+    // Set when reading the input failed, as opposed to reaching its end.
+    bool failed() const { return error; }
+
+    // Replaces `batch` with the next points, reading at most `batchSize`
+    // lines or rows. Returns false once the input is exhausted.
+    bool next(std::size_t batchSize, DataPoints& batch);
+
+private:
+    bool nextRows(std::size_t batchSize, DataPoints& batch);
+    bool nextLines(std::size_t batchSize, DataPoints& batch);
+    bool readInput();
+
+    std::shared_ptr<MappedFile> file;
+    DataPoints rows;
+    std::string input;
+    std::size_t position = 0;
+    bool standardInput = false;
+    bool inputEnded = false;
+    bool binary = false;
+    bool opened = false;
+    bool error = false;
+};
+
+#endif //K_MEANS_POINT_STREAM_H
@@ -0,0 +1,239 @@
+#include "seeding.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+// Costs are summed per fixed-size chunk and the chunks are added in order,
+// so sampling does not depend on how OpenMP splits the work.
+const size_t SEEDING_CHUNK_SIZE = 1 << 14;
+
+double uniform(mt19937_64& generator) {
+    return (generator() >> 11) * 0x1.0p-53;
+}
+
+// Stateless generator for the per-point draws of k-means||: the value for a
+// given (seed, round, point) is the same whichever thread computes it.
+double uniform(uint64_t seed, uint64_t round, uint64_t index) {
+    uint64_t z = seed + 0x9E3779B97F4A7C15ULL * (round * 0x100000001B3ULL + index + 1);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z ^= z >> 31;
+    return (z >> 11) * 0x1.0p-53;
+}
+
+inline float squaredDistance(const DataPoints& points, size_t i, const DataPoints& centers, size_t j) {
+    float distance = 0;
+    for (int d = 0; d < points.dimension(); d++) {
+        float difference = points[d][i] - centers[d][j];
+        distance += difference * difference;
+    }
+    return distance;
+}
+
+// Lowers each point's squared distance to its nearest center with the
+// centers from `firstCenter` on, and returns the total cost.
+double addCenters(const DataPoints& points, const DataPoints& centers, size_t firstCenter,
+                  vector<float>& minDistances, vector<int>& nearest, vector<double>& chunkCosts) {
+    const size_t pointNum = points.size();
+    const size_t centerNum = centers.size();
+    const long chunkNum = static_cast<long>(chunkCosts.size());
+#pragma omp parallel for schedule(dynamic, 1)
+    for (long chunk = 0; chunk < chunkNum; chunk++) {
+        const size_t end = min(pointNum, (chunk + 1) * SEEDING_CHUNK_SIZE);
+        double cost = 0;
+        for (size_t i = chunk * SEEDING_CHUNK_SIZE; i < end; i++) {
+            for (size_t j = firstCenter; j < centerNum; j++) {
+                float distance = squaredDistance(points, i, centers, j);
+                if (distance < minDistances[i]) {
+                    minDistances[i] = distance;
+                    nearest[i] = static_cast<int>(j);
+                }
+            }
+            cost += minDistances[i];
+        }
+        chunkCosts[chunk] = cost;
+    }
+    double totalCost = 0;
+    for (double cost : chunkCosts) totalCost += cost;
+    return totalCost;
+}
+
+// Index of the point where the running cost first exceeds `target`.
+size_t sampleByCost(const vector<float>& minDistances, const vector<double>& chunkCosts, double target) {
+    size_t chunk = 0;
+    while (chunk + 1 < chunkCosts.size() && target >= chunkCosts[chunk]) {
+        target -= chunkCosts[chunk];
+        chunk++;
+    }
+    const size_t end = min(minDistances.size(), (chunk + 1) * SEEDING_CHUNK_SIZE);
+    size_t candidate = chunk * SEEDING_CHUNK_SIZE;
+    for (size_t i = candidate; i < end; i++) {
+        if (minDistances[i] > 0) candidate = i;
+        target -= minDistances[i];
+        if (target < 0) return i;
+    }
+    return candidate;
+}
+
+void seedRandom(const DataPoints& points, const SeedingOptions& options, DataPoints& centroids) {
+    mt19937_64 generator(options.seed);
+    vector<size_t> chosen;
+    while (chosen.size() < static_cast<size_t>(options.clusterNum)) {
+        size_t index = generator() % points.size();
+        if (find(chosen.begin(), chosen.end(), index) == chosen.end()) chosen.push_back(index);
+    }
+    for (size_t index : chosen) centroids.pushPoint(points, index);
+}
+
+void seedKMeansPlusPlus(const DataPoints& points, const SeedingOptions& options, DataPoints& centroids) {
+    const size_t pointNum = points.size();
+    mt19937_64 generator(options.seed);
+    vector<float> minDistances(pointNum, HUGE_VALF);
+    vector<int> nearest(pointNum, 0);
+    vector<double> chunkCosts((pointNum + SEEDING_CHUNK_SIZE - 1) / SEEDING_CHUNK_SIZE);
+
+    DataPoints centers(points.dimension());
+    centers.pushPoint(points, generator() % pointNum);
+    double cost = addCenters(points, centers, 0, minDistances, nearest, chunkCosts);
+    while (centers.size() < static_cast<size_t>(options.clusterNum)) {
+        size_t index = cost > 0 ? sampleByCost(minDistances, chunkCosts, uniform(generator) * cost)
+                                : generator() % pointNum;
+        centers.pushPoint(points, index);
+        cost = addCenters(points, centers, centers.size() - 1, minDistances, nearest, chunkCosts);
+    }
+    centroids = centers;
+}
+
+// k-means|| (Bahmani et al.): a few rounds of independent oversampling in
+// parallel, then weighted k-means++ on the much smaller candidate set.
+void seedKMeansParallel(const DataPoints& points, const SeedingOptions& options, DataPoints& centroids) {
+    const size_t pointNum = points.size();
+    const size_t chunkNum = (pointNum + SEEDING_CHUNK_SIZE - 1) / SEEDING_CHUNK_SIZE;
+    mt19937_64 generator(options.seed);
+    vector<float> minDistances(pointNum, HUGE_VALF);
+    vector<int> nearest(pointNum, 0);
+    vector<double> chunkCosts(chunkNum);
+
+    DataPoints candidates(points.dimension());
+    candidates.pushPoint(points, generator() % pointNum);
+    double cost = addCenters(points, candidates, 0, minDistances, nearest, chunkCosts);
+    const double expectedSamples = options.oversampling * options.clusterNum;
+    vector<vector<size_t>> chunkSamples(chunkNum);
+    for (int round = 0; round < options.rounds && cost > 0; round++) {
+#pragma omp parallel for schedule(dynamic, 1)
+        for (long chunk = 0; chunk < static_cast<long>(chunkNum); chunk++) {
+            chunkSamples[chunk].clear();
+            const size_t end = min(pointNum, (chunk + 1) * SEEDING_CHUNK_SIZE);
+            for (size_t i = chunk * SEEDING_CHUNK_SIZE; i < end; i++) {
+                if (uniform(options.seed, round, i) < expectedSamples * minDistances[i] / cost) {
+                    chunkSamples[chunk].push_back(i);
+                }
+            }
+        }
+        const size_t firstNew = candidates.size();
+        for (const auto& samples : chunkSamples) {
+            for (size_t index : samples) candidates.pushPoint(points, index);
+        }
+        cost = addCenters(points, candidates, firstNew, minDistances, nearest, chunkCosts);
+    }
+
+    const size_t candidateNum = candidates.size();
+    vector<double> weights(candidateNum, 0);
+    for (size_t i = 0; i < pointNum; i++) weights[nearest[i]]++;
+
+    // Weighted k-means++ over the candidates.
+    vector<float> candidateDistances(candidateNum, HUGE_VALF);
+    vector<char> taken(candidateNum, 0);
+    DataPoints centers(points.dimension());
+    while (centers.size() < static_cast<size_t>(options.clusterNum) && centers.size() < candidateNum) {
+        double total = 0;
+        for (size_t c = 0; c < candidateNum; c++) {
+            if (!taken[c]) total += weights[c] * (centers.empty() ? 1.0 : candidateDistances[c]);
+        }
+        size_t chosen = candidateNum;
+        double target = uniform(generator) * total;
+        for (size_t c = 0; c < candidateNum; c++) {
+            if (taken[c]) continue;
+            chosen = c;
+            target -= weights[c] * (centers.empty() ? 1.0 : candidateDistances[c]);
+            if (target < 0) break;
+        }
+        taken[chosen] = 1;
+        centers.pushPoint(candidates, chosen);
+        for (size_t c = 0; c < candidateNum; c++) {
+            candidateDistances[c] = min(candidateDistances[c], squaredDistance(candidates, c, centers, centers.size() - 1));
+        }
+    }
+
+    // Fewer candidates than clusters (tiny or degenerate data): top up with
+    // random points.
+    while (centers.size() < static_cast<size_t>(options.clusterNum)) {
+        centers.pushPoint(points, generator() % pointNum);
+    }
+    centroids = centers;
+}
+
+}
+
+bool readSeedingOptions(const INIReader& reader, const string& section, int clusterNum, SeedingOptions& options) {
+    const string init = reader.Get(section, "init", "config");
+    if (init == "config") {
+        options.method = SeedingMethod::Config;
+    } else if (init == "random") {
+        options.method = SeedingMethod::Random;
+    } else if (init == "kmeans++") {
+        options.method = SeedingMethod::KMeansPlusPlus;
+    } else if (init == "kmeans||") {
+        options.method = SeedingMethod::KMeansParallel;
+    } else {
+        cerr << "Error: unknown init method " << init << endl;
+        return false;
+    }
+    options.clusterNum = clusterNum;
+    options.seed = static_cast<uint64_t>(reader.GetInteger(section, "seed", 0));
+    options.oversampling = reader.GetReal(section, "oversampling", options.oversampling);
+    options.rounds = static_cast<int>(reader.GetInteger(section, "rounds", options.rounds));
+    return true;
+}
+
+const char* seedingMethodName(SeedingMethod method) {
+    switch (method) {
+        case SeedingMethod::Random:
+            return "random";
+        case SeedingMethod::KMeansPlusPlus:
+            return "kmeans++";
+        case SeedingMethod::KMeansParallel:
+            return "kmeans||";
+        default:
+            return "config";
+    }
+}
+
+bool seedCentroids(const DataPoints& points, const SeedingOptions& options, DataPoints& centroids) {
+    if (options.clusterNum <= 0 || points.size() < static_cast<size_t>(options.clusterNum)) {
+        cerr << "Error: cannot pick " << options.clusterNum << " centroids from " << points.size() << " points" << endl;
+        return false;
+    }
+    centroids = DataPoints(points.dimension());
+    switch (options.method) {
+        case SeedingMethod::Random:
+            seedRandom(points, options, centroids);
+            break;
+        case SeedingMethod::KMeansPlusPlus:
+            seedKMeansPlusPlus(points, options, centroids);
+            break;
+        case SeedingMethod::KMeansParallel:
+            seedKMeansParallel(points, options, centroids);
+            break;
+        default:
+            cerr << "Error: centroids of a config section cannot be picked from the dataset" << endl;
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,33 @@
+#ifndef K_MEANS_SEEDING_H
+#define K_MEANS_SEEDING_H
+
+#include "INIReader.h"
+#include "data_points.h"
+#include <cstdint>
+#include <string>
+
+// How the initial centroids are chosen. Config reads them from the
+// "centroidN" entries of the INI section; the other methods pick them from
+// the dataset.
+enum class SeedingMethod { Config, Random, KMeansPlusPlus, KMeansParallel };
+
+struct SeedingOptions {
+    SeedingMethod method = SeedingMethod::Config;
+    int clusterNum = 0;
+    std::uint64_t seed = 0;
+    // k-means|| samples about oversampling * clusterNum candidates per round.
+    double oversampling = 2;
+    int rounds = 5;
+};
+
+// Reads "init" (config, random, kmeans++ or kmeans||), "seed",
+// "oversampling" and "rounds" from `section`.
+bool readSeedingOptions(const INIReader& reader, const std::string& section, int clusterNum, SeedingOptions& options);
+
+const char* seedingMethodName(SeedingMethod method);
+
+// Picks options.clusterNum centroids from `points`. The result depends only
+// on the options and the data, not on the number of threads.
+bool seedCentroids(const DataPoints& points, const SeedingOptions& options, DataPoints& centroids);
+
+#endif //K_MEANS_SEEDING_H
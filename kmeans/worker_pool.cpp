@@ -0,0 +1,129 @@
+#include "worker_pool.h"
+
+using namespace std;
+
+namespace {
+
+// Checks of the barrier before sleeping; a few microseconds.
+const int BARRIER_SPINS = 4000;
+
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        lock_guard<mutex> lock(guard);
+        stopping = true;
+    }
+    started.notify_all();
+    for (auto& worker : workers) worker.join();
+}
+
+void WorkerPool::run(int workerNum, const function<void(int)>& task) {
+    if (workerNum <= 1) {
+        task(0);
+        return;
+    }
+    {
+        unique_lock<mutex> lock(guard);
+        while (static_cast<int>(workers.size()) < workerNum - 1) {
+            const int worker = static_cast<int>(workers.size()) + 1;
+            workers.emplace_back([this, worker] { work(worker); });
+        }
+        currentTask = &task;
+        currentWorkers = workerNum;
+        pending = workerNum - 1;
+        generation++;
+    }
+    started.notify_all();
+    task(0);
+    unique_lock<mutex> lock(guard);
+    finished.wait(lock, [this] { return pending == 0; });
+    currentTask = nullptr;
+}
+
+void WorkerPool::work(int worker) {
+    // Threads started during a run must not take it for a new one.
+    uint64_t seen;
+    {
+        lock_guard<mutex> lock(guard);
+        seen = generation - (currentTask ? 1 : 0);
+    }
+    while (true) {
+        const function<void(int)>* task;
+        {
+            unique_lock<mutex> lock(guard);
+            started.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+            if (worker >= currentWorkers) continue;
+            task = currentTask;
+        }
+        (*task)(worker);
+        lock_guard<mutex> lock(guard);
+        if (--pending == 0) finished.notify_one();
+    }
+}
+
+WorkerPool& defaultWorkerPool() {
+    static WorkerPool pool;
+    return pool;
+}
+
+void SpinBarrier::wait() {
+    const uint64_t current = phase.load(memory_order_acquire);
+    if (arrived.fetch_add(1, memory_order_acq_rel) == count - 1) {
+        arrived.store(0, memory_order_relaxed);
+        {
+            lock_guard<mutex> lock(guard);
+            phase.store(current + 1, memory_order_release);
+        }
+        released.notify_all();
+        return;
+    }
+    for (int spin = 0; spin < BARRIER_SPINS; spin++) {
+        if (phase.load(memory_order_acquire) != current) return;
+        this_thread::yield();
+    }
+    unique_lock<mutex> lock(guard);
+    released.wait(lock, [&] { return phase.load(memory_order_acquire) != current; });
+}
+
+void ChunkStealer::reset(size_t chunkNum, int workerNum) {
+    if (rangeNum != workerNum) {
+        ranges.reset(new Range[workerNum]);
+        rangeNum = workerNum;
+    }
+    for (int worker = 0; worker < workerNum; worker++) {
+        ranges[worker].bounds.store(pack(worker * chunkNum / workerNum, (worker + 1) * chunkNum / workerNum),
+                                    memory_order_relaxed);
+    }
+}
+
+bool ChunkStealer::next(int worker, size_t& chunk) {
+    atomic<uint64_t>& own = ranges[worker].bounds;
+    uint64_t bounds = own.load(memory_order_acquire);
+    while ((bounds >> 32) < (bounds & 0xffffffff)) {
+        if (own.compare_exchange_weak(bounds, pack((bounds >> 32) + 1, bounds & 0xffffffff),
+                                      memory_order_acq_rel)) {
+            chunk = bounds >> 32;
+            return true;
+        }
+    }
+    for (int offset = 1; offset < rangeNum; offset++) {
+        atomic<uint64_t>& victim = ranges[(worker + offset) % rangeNum].bounds;
+        uint64_t victimBounds = victim.load(memory_order_acquire);
+        while ((victimBounds >> 32) < (victimBounds & 0xffffffff)) {
+            const uint64_t begin = victimBounds >> 32;
+            const uint64_t end = victimBounds & 0xffffffff;
+            const uint64_t middle = begin + (end - begin) / 2;
+            if (victim.compare_exchange_weak(victimBounds, pack(begin, middle), memory_order_acq_rel)) {
+                // Thieves leave empty ranges alone, so the rest of the
+                // stolen chunks can be stored without a compare-and-swap.
+                own.store(pack(middle + 1, end), memory_order_release);
+                chunk = middle;
+                return true;
+            }
+        }
+    }
+    return false;
+}
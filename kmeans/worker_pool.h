@@ -0,0 +1,91 @@
+#ifndef K_MEANS_WORKER_POOL_H
+#define K_MEANS_WORKER_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent std::thread workers, an alternative to OpenMP parallel regions.
+// The threads are started on first use and then sleep between runs, so one
+// pool can serve any number of fits, with a different number of workers
+// each time.
+class WorkerPool {
+public:
+    WorkerPool() = default;
+    ~WorkerPool();
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    // Calls task(worker) for worker in [0, workerNum) concurrently and returns
+    // when every call has returned. Worker 0 is the calling thread; the pool
+    // starts more threads when it has fewer than workerNum - 1. One run at a
+    // time.
+    void run(int workerNum, const std::function<void(int)>& task);
+
+    // Threads started so far, not counting the callers of run().
+    int threads() const { return static_cast<int>(workers.size()); }
+
+private:
+    void work(int worker);
+
+    std::vector<std::thread> workers;
+    std::mutex guard;
+    std::condition_variable started;
+    std::condition_variable finished;
+    const std::function<void(int)>* currentTask = nullptr;
+    int currentWorkers = 0;
+    int pending = 0;
+    std::uint64_t generation = 0;
+    bool stopping = false;
+};
+
+// The pool shared by the worker-pool backend.
+WorkerPool& defaultWorkerPool();
+
+// Reusable barrier for `count` threads. Waiters spin for a while, which is
+// enough when the phases are balanced, then sleep until the last one arrives.
+class SpinBarrier {
+public:
+    explicit SpinBarrier(int count) : count(count) {}
+
+    void wait();
+
+private:
+    const int count;
+    std::atomic<int> arrived{0};
+    std::atomic<std::uint64_t> phase{0};
+    std::mutex guard;
+    std::condition_variable released;
+};
+
+// Chunks [0, chunkNum) split among workers. Each worker starts with a
+// contiguous share and, once it is done, steals the upper half of the chunks
+// another worker has left.
+class ChunkStealer {
+public:
+    // Not thread-safe: call between runs, or from one worker between barriers.
+    void reset(std::size_t chunkNum, int workerNum);
+
+    // Next chunk for `worker`; false when no worker has any left.
+    bool next(int worker, std::size_t& chunk);
+
+private:
+    // [begin, end) of one worker, packed in one word so that the owner and
+    // the thieves update it with a single compare-and-swap.
+    struct alignas(64) Range {
+        std::atomic<std::uint64_t> bounds{0};
+    };
+
+    static std::uint64_t pack(std::uint64_t begin, std::uint64_t end) { return begin << 32 | end; }
+
+    std::unique_ptr<Range[]> ranges;
+    int rangeNum = 0;
+};
+
+#endif //K_MEANS_WORKER_POOL_H
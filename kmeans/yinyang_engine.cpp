@@ -0,0 +1,332 @@
+#include "yinyang_engine.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace {
+
+// Centroids per group; fewer clusters than this make a single group.
+const int YINYANG_GROUP_SIZE = 10;
+// Lloyd iterations over the centroids that form the groups.
+const int GROUPING_ITERATIONS = 5;
+// Relative margin applied to the bound tests, well above the rounding error
+// of the float squared distances used by the brute-force scan.
+const double BOUND_TOLERANCE = 1e-5;
+// Dimensions with their own compiled copy of the scans.
+const int YINYANG_MAX_DIMENSION = 8;
+// Rows of the drift table; when it is full the bounds of every point are
+// loosened up to the last row, which becomes the first one.
+const size_t MAX_DRIFT_ROWS = 16;
+
+// Group bounds are stored as floats. Scaling a bound down by more than the
+// float rounding error keeps it a valid lower bound, and the group shifts
+// are rounded up for the same reason.
+inline float roundedDown(double value) {
+    return static_cast<float>(value * (1 - 1.2e-7));
+}
+
+inline float roundedUp(double value) {
+    return static_cast<float>(value * (1 + 1.2e-7));
+}
+
+// Summed in coordinate order, like the assignment kernels. D == 0 stands for
+// any dimension.
+template<int D>
+inline float squaredDistance(const float* centroid, const float* point, int dimension) {
+    const int dims = D > 0 ? D : dimension;
+    float difference = centroid[0] - point[0];
+    float distance = difference * difference;
+    for (int d = 1; d < dims; d++) {
+        difference = centroid[d] - point[d];
+        distance += difference * difference;
+    }
+    return distance;
+}
+
+}
+
+YinyangEngine::YinyangEngine(size_t pointNum) : pointNum(pointNum), pointLabels(pointNum), upper(pointNum) {}
+
+size_t YinyangEngine::memoryBytes() const {
+    return pointLabels.size() * sizeof(int) + upper.size() * sizeof(double) + lower.size() * sizeof(float) +
+           globalLower.size() * sizeof(float) + boundsUpdate.size() * sizeof(int) + drift.size() * sizeof(double);
+}
+
+void YinyangEngine::formGroups(const DataPoints& centroids) {
+    const int clusterNum = static_cast<int>(centroids.size());
+    const int dimension = centroids.dimension();
+    groupNum = max(1, clusterNum / YINYANG_GROUP_SIZE);
+    groupOf.assign(clusterNum, 0);
+    vector<double> centers(static_cast<size_t>(groupNum) * dimension);
+    for (int g = 0; g < groupNum; g++) {
+        const int first = static_cast<int>(static_cast<long long>(g) * clusterNum / groupNum);
+        for (int d = 0; d < dimension; d++) centers[g * dimension + d] = centroids[d][first];
+    }
+    for (int iteration = 0; iteration < GROUPING_ITERATIONS && groupNum > 1; iteration++) {
+        for (int j = 0; j < clusterNum; j++) {
+            double shortest = HUGE_VAL;
+            for (int g = 0; g < groupNum; g++) {
+                double distance = 0;
+                for (int d = 0; d < dimension; d++) {
+                    double difference = centroids[d][j] - centers[g * dimension + d];
+                    distance += difference * difference;
+                }
+                if (distance < shortest) {
+                    shortest = distance;
+                    groupOf[j] = g;
+                }
+            }
+        }
+        vector<double> sums(centers.size());
+        vector<int> sizes(groupNum);
+        for (int j = 0; j < clusterNum; j++) {
+            sizes[groupOf[j]]++;
+            for (int d = 0; d < dimension; d++) sums[groupOf[j] * dimension + d] += centroids[d][j];
+        }
+        for (int g = 0; g < groupNum; g++) {
+            for (int d = 0; d < dimension && sizes[g] > 0; d++) {
+                centers[g * dimension + d] = sums[g * dimension + d] / sizes[g];
+            }
+        }
+    }
+
+    groupStart.assign(groupNum + 1, 0);
+    for (int j = 0; j < clusterNum; j++) groupStart[groupOf[j] + 1]++;
+    for (int g = 0; g < groupNum; g++) groupStart[g + 1] += groupStart[g];
+    groupMembers.resize(clusterNum);
+    vector<int> filled(groupStart.begin(), groupStart.end() - 1);
+    position.resize(clusterNum);
+    for (int j = 0; j < clusterNum; j++) {
+        position[j] = filled[groupOf[j]]++;
+        groupMembers[position[j]] = j;
+    }
+}
+
+void YinyangEngine::update(const DataPoints& centroids) {
+    const int clusterNum = static_cast<int>(centroids.size());
+    const int dimension = centroids.dimension();
+    const bool reshaped = current.dimension() != dimension || current.size() != centroids.size();
+    if (reshaped) {
+        kernel = selectAssignmentKernel(dimension, clusterNum);
+        formGroups(centroids);
+        lower.assign(pointNum * groupNum, 0);
+        globalLower.assign(pointNum, 0);
+        boundsUpdate.assign(pointNum, 0);
+    }
+    // As in the Hamerly engine, an empty cluster (NaN centroid) forces a full
+    // scan to keep brute-force labels.
+    initialized = !reshaped && !current.empty();
+    for (const auto& column : centroids.columns) {
+        for (float value : column) {
+            if (!isfinite(value)) initialized = false;
+        }
+    }
+    shift.assign(clusterNum, 0);
+    // Centroid shifts in groupMembers order, then group shifts, then the
+    // largest one.
+    const size_t row = clusterNum + groupNum + 1;
+    vector<float> roundedShift(row, 0);
+    if (initialized) {
+        for (int j = 0; j < clusterNum; j++) {
+            float squared = 0;
+            for (int d = 0; d < dimension; d++) {
+                float difference = centroids[d][j] - current[d][j];
+                squared = d == 0 ? difference * difference : squared + difference * difference;
+            }
+            shift[j] = sqrt(static_cast<double>(squared));
+            const float rounded = roundedUp(shift[j]);
+            roundedShift[position[j]] = rounded;
+            float& group = roundedShift[clusterNum + groupOf[j]];
+            group = max(group, rounded);
+            roundedShift[row - 1] = max(roundedShift[row - 1], rounded);
+        }
+        const size_t previous = drift.size() - row;
+        for (size_t c = 0; c < row; c++) drift.push_back(drift[previous + c] + roundedShift[c]);
+        if (drift.size() / row > MAX_DRIFT_ROWS) rebaseBounds(clusterNum);
+    } else {
+        // Every point is scanned again and starts from the first row.
+        drift.assign(row, 0);
+    }
+    current = centroids;
+    coordinates.resize(static_cast<size_t>(clusterNum) * dimension);
+    for (int m = 0; m < clusterNum; m++) {
+        for (int d = 0; d < dimension; d++) coordinates[m * dimension + d] = centroids[d][groupMembers[m]];
+    }
+}
+
+void YinyangEngine::rebaseBounds(int clusterNum) {
+    const size_t row = clusterNum + groupNum + 1;
+    const double* driftNow = drift.data() + drift.size() - row;
+    for (size_t i = 0; i < pointNum; i++) {
+        const double* driftThen = drift.data() + static_cast<size_t>(boundsUpdate[i]) * row;
+        boundsUpdate[i] = 0;
+        if (driftThen == driftNow) continue;
+        // A group drift is at least the drift of each of its members, so the
+        // local filter can keep loosening the group bound by the members'.
+        float* bounds = lower.data() + i * groupNum;
+        for (int g = 0; g < groupNum; g++) {
+            bounds[g] = max(0.0f, roundedDown(bounds[g] - (driftNow[clusterNum + g] - driftThen[clusterNum + g])));
+        }
+        globalLower[i] = max(0.0f, roundedDown(globalLower[i] - (driftNow[row - 1] - driftThen[row - 1])));
+    }
+    drift.assign(row, 0);
+}
+
+template<int D>
+void YinyangEngine::scanAll(const DataPoints& points, size_t begin, size_t end) {
+    const int clusterNum = static_cast<int>(current.size());
+    const int dimension = D > 0 ? D : current.dimension();
+    const vector<const float*> columns = points.columnData();
+    const vector<const float*> centroids = current.columnData();
+    vector<float> point(dimension);
+    for (size_t block = begin; block < end; block += ASSIGNMENT_BLOCK_SIZE) {
+        const size_t blockSize = min(ASSIGNMENT_BLOCK_SIZE, end - block);
+        kernel.assign(columns.data(), block, blockSize, centroids.data(), dimension, clusterNum,
+                      pointLabels.data() + block);
+    }
+    for (size_t i = begin; i < end; i++) {
+        for (int d = 0; d < dimension; d++) point[d] = columns[d][i];
+        const int label = pointLabels[i];
+        float* bounds = lower.data() + i * groupNum;
+        upper[i] = sqrt(static_cast<double>(squaredDistance<D>(coordinates.data() + position[label] * dimension, point.data(), dimension)));
+        globalLower[i] = HUGE_VALF;
+        boundsUpdate[i] = 0;
+        for (int g = 0; g < groupNum; g++) {
+            float bound = HUGE_VALF;
+            for (int m = groupStart[g]; m < groupStart[g + 1]; m++) {
+                if (groupMembers[m] == label) continue;
+                bound = min(bound, squaredDistance<D>(coordinates.data() + m * dimension, point.data(), dimension));
+            }
+            bounds[g] = roundedDown(sqrt(static_cast<double>(bound)));
+            globalLower[i] = min(globalLower[i], bounds[g]);
+        }
+    }
+}
+
+template<int D>
+size_t YinyangEngine::assign(const DataPoints& points, size_t begin, size_t end) {
+    const int clusterNum = static_cast<int>(current.size());
+    if (!initialized) {
+        scanAll<D>(points, begin, end);
+        return (end - begin) * clusterNum;
+    }
+    const int dimension = D > 0 ? D : current.dimension();
+    const size_t row = clusterNum + groupNum + 1;
+    const vector<const float*> columns = points.columnData();
+    vector<float> point(dimension);
+    // Nearest and second nearest computed distance of every scanned group,
+    // squared, and the smallest bound of the members the local filter skipped.
+    vector<float> nearest(groupNum);
+    vector<float> secondNearest(groupNum);
+    vector<int> nearestIndex(groupNum);
+    vector<float> skippedNearest(groupNum);
+    vector<int> scannedGroups;
+    scannedGroups.reserve(groupNum);
+    size_t evaluations = 0;
+
+    for (size_t i = begin; i < end; i++) {
+        const int label = pointLabels[i];
+        const double upperBound = upper[i] + shift[label];
+        // The bounds were last brought up to date at update boundsUpdate[i];
+        // the drift since then loosens them.
+        const double* driftThen = drift.data() + static_cast<size_t>(boundsUpdate[i]) * row;
+        const double* driftNow = drift.data() + drift.size() - row;
+        // Global filter: no group can hold a closer centroid.
+        const double globalBound = globalLower[i] - (driftNow[row - 1] - driftThen[row - 1]);
+        if (upperBound < globalBound * (1 - BOUND_TOLERANCE)) {
+            upper[i] = upperBound;
+            continue;
+        }
+        for (int d = 0; d < dimension; d++) point[d] = columns[d][i];
+        float bestSquared = squaredDistance<D>(coordinates.data() + position[label] * dimension, point.data(), dimension);
+        evaluations++;
+        const double labelDistance = sqrt(static_cast<double>(bestSquared));
+        double bestDistance = labelDistance;
+        int best = label;
+        if (bestDistance < globalBound * (1 - BOUND_TOLERANCE)) {
+            upper[i] = bestDistance;
+            continue;
+        }
+
+        // Group filter, then local filter: a member of a scanned group is
+        // skipped when the group bound, loosened by its own drift only, still
+        // beats the best distance. The local filter leaves looser bounds and
+        // mispredicted branches behind, which outweigh the distances it saves
+        // for the dimensions compiled separately, so only larger ones use it.
+        // The group bounds are read and written only here, so the points the
+        // global filter keeps never touch them. Members are in index order,
+        // so the first of equal distances wins as in the assignment kernels.
+        float* bounds = lower.data() + i * groupNum;
+        float limit = roundedUp(bestDistance / (1 - BOUND_TOLERANCE));
+        scannedGroups.clear();
+        for (int g = 0; g < groupNum; g++) {
+            const float storedBound = bounds[g];
+            // A negative bound is worth no more than 0.
+            bounds[g] = max(0.0f, roundedDown(storedBound - (driftNow[clusterNum + g] - driftThen[clusterNum + g])));
+            if (bounds[g] > limit) continue;
+            scannedGroups.push_back(g);
+            const int firstMember = groupStart[g];
+            float nearestSquared = HUGE_VALF;
+            float secondSquared = HUGE_VALF;
+            float skipped = HUGE_VALF;
+            int nearestMember = firstMember;
+            for (int m = firstMember; m < groupStart[g + 1]; m++) {
+                // The stored bound does not cover the point's own centroid.
+                const float own = D == 0 ? roundedDown(storedBound - (driftNow[m] - driftThen[m])) : 0;
+                if (D == 0 && own > limit && groupMembers[m] != label) {
+                    skipped = min(skipped, own);
+                    continue;
+                }
+                const float squared = squaredDistance<D>(coordinates.data() + m * dimension, point.data(), dimension);
+                evaluations++;
+                if (squared < nearestSquared) {
+                    secondSquared = nearestSquared;
+                    nearestSquared = squared;
+                    nearestMember = m;
+                } else {
+                    secondSquared = min(secondSquared, squared);
+                }
+            }
+            const int j = groupMembers[nearestMember];
+            if (nearestSquared < bestSquared || (nearestSquared == bestSquared && j < best)) {
+                bestSquared = nearestSquared;
+                bestDistance = sqrt(static_cast<double>(nearestSquared));
+                best = j;
+                limit = roundedUp(bestDistance / (1 - BOUND_TOLERANCE));
+            }
+            nearest[g] = nearestSquared;
+            secondNearest[g] = secondSquared;
+            nearestIndex[g] = j;
+            skippedNearest[g] = skipped;
+        }
+        for (int g : scannedGroups) {
+            const float squared = nearestIndex[g] == best ? secondNearest[g] : nearest[g];
+            bounds[g] = min(roundedDown(sqrt(static_cast<double>(squared))), skippedNearest[g]);
+        }
+        // The old centroid now counts against the bound of its group.
+        if (best != label) {
+            float& bound = bounds[groupOf[label]];
+            bound = min(bound, roundedDown(labelDistance));
+        }
+        float smallest = HUGE_VALF;
+        for (int g = 0; g < groupNum; g++) smallest = min(smallest, bounds[g]);
+        globalLower[i] = smallest;
+        boundsUpdate[i] = static_cast<int>(drift.size() / row) - 1;
+        pointLabels[i] = best;
+        upper[i] = bestDistance;
+    }
+    return evaluations;
+}
+
+template<int... D>
+size_t YinyangEngine::assign(const DataPoints& points, size_t begin, size_t end, integer_sequence<int, D...>) {
+    const int dimension = current.dimension();
+    size_t evaluations = 0;
+    bool specialized = ((dimension == D + 1 && (evaluations = assign<D + 1>(points, begin, end), true)) || ...);
+    return specialized ? evaluations : assign<0>(points, begin, end);
+}
+
+size_t YinyangEngine::assign(const DataPoints& points, size_t begin, size_t end) {
+    return assign(points, begin, end, make_integer_sequence<int, YINYANG_MAX_DIMENSION>());
+}
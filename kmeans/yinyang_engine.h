@@ -0,0 +1,76 @@
+#ifndef K_MEANS_YINYANG_ENGINE_H
+#define K_MEANS_YINYANG_ENGINE_H
+
+#include "assignment_kernel.h"
+#include "data_points.h"
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Yinyang k-means (Ding et al.) for large cluster counts. The centroids are
+// split once into about K / 10 groups by clustering them; each point keeps an
+// upper bound on the distance to its centroid and one lower bound per group,
+// loosened every update by the largest shift in the group. A point is
+// skipped when its bound beats every group bound; otherwise only the groups
+// whose bound fails are scanned. Labels are the ones the brute-force scan
+// would produce: bounds are tested with a safety margin and ties go to the
+// lowest index.
+class YinyangEngine {
+public:
+    explicit YinyangEngine(std::size_t pointNum);
+
+    // Same contract as HamerlyEngine::update.
+    void update(const DataPoints& centroids);
+
+    // Assigns the points in [begin, end) and returns how many point-centroid
+    // distances were computed. Disjoint ranges can run concurrently.
+    std::size_t assign(const DataPoints& points, std::size_t begin, std::size_t end);
+
+    const int* labels() const { return pointLabels.data(); }
+    int groups() const { return groupNum; }
+    // Bytes taken by the labels and bounds of the points.
+    std::size_t memoryBytes() const;
+
+private:
+    void formGroups(const DataPoints& centroids);
+    // Applies the drift up to the last row to the bounds of every point, so
+    // that the drift table can restart from that row.
+    void rebaseBounds(int clusterNum);
+    template<int D>
+    void scanAll(const DataPoints& points, std::size_t begin, std::size_t end);
+    template<int D>
+    std::size_t assign(const DataPoints& points, std::size_t begin, std::size_t end);
+    template<int... D>
+    std::size_t assign(const DataPoints& points, std::size_t begin, std::size_t end,
+                       std::integer_sequence<int, D...>);
+
+    AssignmentKernel kernel;
+    std::size_t pointNum;
+    std::vector<int> pointLabels;
+    std::vector<double> upper;
+    // groupNum bounds per point, rounded down when stored, and their minimum.
+    std::vector<float> lower;
+    std::vector<float> globalLower;
+    // Row of `drift` at which the bounds of the point were last updated.
+    std::vector<int> boundsUpdate;
+    // One row per update since the last full scan or rebaseBounds(): the
+    // summed shift of every centroid, the summed largest shift of every group,
+    // then the summed largest shift of all the centroids.
+    std::vector<double> drift;
+
+    int groupNum = 0;
+    std::vector<int> groupOf;
+    // Members of group g, in index order: groupMembers[groupStart[g]...].
+    std::vector<int> groupStart;
+    std::vector<int> groupMembers;
+    // Where centroid j sits in groupMembers.
+    std::vector<int> position;
+
+    DataPoints current;
+    // Current centroids interleaved, in groupMembers order.
+    std::vector<float> coordinates;
+    std::vector<double> shift;
+    bool initialized = false;
+};
+
+#endif //K_MEANS_YINYANG_ENGINE_H